@@ -0,0 +1,53 @@
+/*
+    header serialization: the status line, a typical set of response
+    headers and the blank line, written into the response buffer and
+    drained again, 'runs' times.
+
+    make bench && ./bench/headers [runs]
+*/
+#include "Response.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <sys/time.h>
+
+static double  now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+int main(int argc, char **argv)
+{
+    long runs = argc > 1 ? std::atol(argv[1]) : 1000000;
+
+    HTTPResponse    response("HTTP/1.1");
+    const std::string type("text/html");
+    const std::string etag("\"4d2-1f40-65f1a2b3\"");
+    const std::string modified("Wed, 13 Mar 2024 12:00:00 GMT");
+    char    buff[BUFF_SIZE];
+    size_t  bytes = 0;
+
+    double t = now();
+    for (long i = 0; i < runs; ++i)
+    {
+        response.reset();
+        response.startLine(200);
+        response.addHeader("Content-Type", type);
+        response.addHeader("Content-Length", static_cast<size_t>(8000 + (i & 1023)));
+        response.addHeader("ETag", etag);
+        response.addHeader("Last-Modified", modified);
+        response.addHeader("Accept-Ranges", "bytes");
+        response.addHeader("Connection", "keep-alive");
+        response.endHeaders();
+
+        size_t n = response.peekHead(buff, sizeof(buff));
+        response.consume(n);
+        bytes += n;
+    }
+    double elapsed = now() - t;
+
+    std::printf("%ld responses, %lu bytes of headers\n", runs, static_cast<unsigned long>(bytes));
+    std::printf("%.1f ns per response\n", elapsed * 1000 / runs);
+    return 0;
+}
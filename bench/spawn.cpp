@@ -0,0 +1,86 @@
+/*
+    cgi launch latency against the server's size: fork()+exec copies the
+    page tables of the parent, spawnProcess() (posix_spawn) doesn't.
+    the resident set is grown by touching a heap block, then /bin/true is
+    started and reaped 'runs' times per method at each size.
+
+    make bench && ./bench/spawn [runs]
+*/
+#include "Spawn.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+static double  now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+static pid_t   forkExec(char* const argv[], int in, int out)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        execve(argv[0], argv, environ);
+        _exit(127);
+    }
+    return pid;
+}
+
+int main(int argc, char **argv)
+{
+    int runs = argc > 1 ? std::atoi(argv[1]) : 200;
+    const size_t sizes[] = { 0, 64, 256, 1024, 4096 }; // MB of rss
+
+    char    prog[] = "/bin/true";
+    char*   args[] = { prog, NULL };
+    int     null = open("/dev/null", O_RDWR | O_CLOEXEC);
+    std::vector<char*> blocks;
+
+    std::printf("%8s %14s %14s\n", "rss MB", "fork+exec us", "spawn us");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i)
+    {
+        size_t grow = sizes[i] - (i ? sizes[i - 1] : 0);
+        if (grow)
+        {
+            char* block = static_cast<char*>(std::malloc(grow << 20));
+            if (!block)
+                break;
+            std::memset(block, 1, grow << 20);
+            blocks.push_back(block);
+        }
+
+        double forked = 0, spawned = 0;
+        for (int r = 0; r < runs; ++r)
+        {
+            double t = now();
+            pid_t pid = forkExec(args, null, null);
+            if (pid > 0)
+                waitpid(pid, NULL, 0);
+            forked += now() - t;
+
+            t = now();
+            pid = spawnProcess(args, environ, null, null);
+            if (pid > 0)
+                waitpid(pid, NULL, 0);
+            spawned += now() - t;
+        }
+        std::printf("%8lu %14.1f %14.1f\n", static_cast<unsigned long>(sizes[i]),
+                    forked / runs, spawned / runs);
+    }
+    for (size_t i = 0; i < blocks.size(); ++i)
+        std::free(blocks[i]);
+    close(null);
+    return 0;
+}
@@ -12,12 +12,15 @@
 #include <set>
 
 #include "SpecialResponse.hpp"
+#include "LocationTree.hpp"
+#include "DirListing.hpp"
 
 using namespace std;
 
 class WebConfigFile;
 struct ServerConfig;
 struct Location;
+class CGIWorkerPool;
 
 class WebConfigFile
 {
@@ -30,8 +33,6 @@ public:
 
     vector<ServerConfig> &getServers();
 
-    ServerConfig getServer(const string &name);
-
     void addServer(const ServerConfig &server);
 
     ~WebConfigFile();
@@ -44,26 +45,50 @@ struct ServerConfig
     size_t maxBody;
     int client_timeout;
     string name;
+    vector<string> names;
     string root;
     vector<string> indexFiles;
     vector<Location> locations;
-    map<int, string> errors;
+    LocationTree routes;
+    map<int, string> errors;            // error_page paths
+    map<int, contentPtr> errorPages;    // every error response, see loadErrorPages()
 
     ServerConfig();
+
+    // renders the built-in pages and the error_page files once, so an error
+    // is sent from memory like any cached response
+    void loadErrorPages();
 };
 
 struct Location
 {
     string route;
+    routeType type;
     string root;
+    int rootFd;
     size_t maxBody;
     int client_timeout;
     bool autoindex;
+    autoindexFormat autoindex_format;
+    size_t autoindex_page_size;
+    bool gzip_static;
+    bool gzip;
+    vector<string> gzip_types;
+    long gzip_min_length;
+    int gzip_comp_level;
     string cgi;
+    string fastcgi;
     int cgi_timeout;
+    string cgi_worker;              // the runner of a worker pool
+    size_t cgi_workers_min;
+    size_t cgi_workers_max;         // 0, no pool
+    size_t cgi_worker_requests;
+    int cgi_worker_idle;
+    CGIWorkerPool *workers;         // shared with the locations running the same script
     string upload;
     string redirect;
     vector<string> indexFiles;
+    vector<string> tryFiles;
     vector<string> methods;
     string scriptInterpreter;
 
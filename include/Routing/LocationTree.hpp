@@ -0,0 +1,66 @@
+#ifndef WEBSERV_LOCATIONTREE_HPP
+#define WEBSERV_LOCATIONTREE_HPP
+
+#include <string>
+#include <vector>
+
+// how a location's route is matched against the request path
+enum routeType
+{
+    ROUTE_PREFIX,   // route /path       the path and everything below it
+    ROUTE_EXACT,    // route = /path     that path only
+    ROUTE_SUFFIX    // route ~ \.php$    any path ending with it
+};
+
+/*
+    every location of a server compiled into one structure, filled while the
+    config is loaded. locations are referred to by their index in
+    ServerConfig::locations, so the tree stays valid when the config is copied.
+
+    - prefix and exact routes share a radix tree of whole path segments,
+      "/img" matches "/img" and "/img/a.png" but never "/imgs"
+    - suffix routes live in a trie of their reversed characters
+
+    a lookup costs the length of the path, whatever the number of locations.
+    like nginx, an exact match wins, then the longest suffix, then the longest
+    prefix.
+*/
+class LocationTree
+{
+    struct segNode
+    {
+        std::string         label;      // one or more whole segments, "/api/v1"
+        int                 prefix;     // location for this path and below, -1 if none
+        int                 exact;      // location for exactly this path, -1 if none
+        std::vector<size_t> children;   // sorted by the first segment of their label
+    };
+
+    struct charNode
+    {
+        int                                     location;
+        std::vector<std::pair<char, size_t> >   children;   // sorted
+    };
+
+    std::vector<segNode>    _segments;  // [0] is the root, "/"
+    std::vector<charNode>   _suffixes;  // [0] is the root, the empty suffix
+
+    size_t  _newSegment(const std::string& label);
+    bool    _findChild(size_t node, const char* seg, size_t len, size_t& at) const;
+    size_t  _insertPath(const std::string& path);
+    int     _findSuffix(const std::string& path) const;
+
+public:
+    LocationTree();
+
+    // false if a location with the same route and type was already added
+    bool    add(const std::string& route, routeType type, int location);
+    // index of the matching location, -1 if none
+    int     find(const std::string& path) const;
+    void    clear();
+
+    // '~' routes are literal suffixes written as a regex anchored at the end,
+    // "\.php$" gives ".php". false for anything else
+    static bool parseSuffix(const std::string& pattern, std::string& suffix);
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "ConfigParser.hpp"
 #include "HTTPParser.hpp"
+#include "FileCache.hpp"
 #include <sys/stat.h>
 
 struct RouteMatch
@@ -15,6 +16,7 @@ struct RouteMatch
     std::string fsPath;
     std::string scriptPath;
     std::string scriptInterpreter;
+    std::string fastcgiPass;    // the application address, empty for a plain CGI
     std::string pathInfo;
 
     bool isCGI;
@@ -22,8 +24,10 @@ struct RouteMatch
     bool isDirectory;
     bool isFile;
     bool doesExist;
+    filePtr file;
 
     bool autoIndex;
+    bool gzipStatic;
     std::string uploadDir;
     std::string redirectUrl;
     size_t maxBodySize;
@@ -37,25 +41,18 @@ struct RouteMatch
 class Routing
 {
 private:
-    ServerConfig &_server;
+    ServerConfig *_server;
 
     Location *_findLocation(const std::string &path);
-    bool _matchesRoute(const std::string &path, const std::string &route);
 
     std::string _resolvePath(Location &loc, const std::string &reqPath);
-    std::string _cleanPath(const std::string &path);
     std::string _joinPath(const std::string &base, const std::string &path);
-    std::string _getRelativePath(const std::string &path, const std::string &route);
+    std::string _getRelativePath(const std::string &path, const Location &loc);
 
     bool _isCGI(Location &loc);
-    void _splitCGIPath(const std::string &fsPath, std::string &scriptPath, std::string &pathInfo);
 
     bool _isMethodAllowed(Location &loc, const std::string &method);
 
-    bool _isPathExists(const std::string &path);
-    bool _isDirectory(const std::string &path);
-    bool _isFile(const std::string &path);
-
     std::string _getRoot(Location &loc);
     size_t _getMaxBodySize(Location &loc);
     std::vector<std::string> _getIndexFiles(Location &loc);
@@ -63,8 +60,17 @@ private:
 public:
     Routing(ServerConfig &server);
 
+    // the virtual host the next requests are routed in
+    void setServer(ServerConfig &server);
+
+    // where 'uri' lands on disk inside 'loc', for try_files candidates
+    std::string resolvePath(Location &loc, const std::string &uri);
+    // the cached file at a path built from 'loc's root
+    filePtr lookup(Location &loc, const std::string &fsPath);
+
     RouteMatch match(const std::string &path, const std::string &method);
-    std::string getErrorPage(int code);
+    // the pre-rendered response for an error, see ServerConfig::loadErrorPages()
+    contentPtr getErrorPage(int code);
     std::string getAllowedMethodsStr(Location &loc);
 };
 
@@ -13,7 +13,9 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <sys/ioctl.h>
 #include <cstring>
+#include <cerrno>
 #include <fstream>
 #include <signal.h>
 #include "Pipe.hpp"
@@ -22,6 +24,10 @@
 #include "Response.hpp"
 #include "FdManager.hpp"
 #include "Routing.hpp"
+#include "FastCGI.hpp"
+#include "CGIWorkers.hpp"
+#include "Spawn.hpp"
+#include "ChildProcess.hpp"
 #include <ctype.h>
 #include "../utils/Logger.hpp"
 #include <time.h>
@@ -30,7 +36,7 @@
 // Helper function to convert int to string
 std::string intToString(int value);
 
-class CGIHandler : public EventHandler
+class CGIHandler : public EventHandler, public FastCGIClient, public ChildWatcher
 {
 private:
 	std::string _scriptPath;
@@ -40,6 +46,8 @@ private:
 	Pipe _inputPipe;
 	Pipe _outputPipe;
 	pid_t _pid;
+	ChildProcess *_process; // NULL once reaped, or given up on by end()
+	int _exitStatus;		// from waitpid() once reaped, -1 before
 	int status;
 	HTTPParser &_Reqparser;
 	HTTPParser _cgiParser;
@@ -49,19 +57,44 @@ private:
 	bool _needBody;
 
 	bool _ShouldAddSLine;
+	bool _splice; // the body is left in the pipe for the client, see HTTPResponse::feedPipe()
+	bool _paused; // the output fd is out of the loop until the client catches up
+	int _clientFd; // -1 once it's going away
+	bool _clientPaused; // not read while the body ring is full, see _watchClient()
+	uint32_t _clientEvents; // what it's watched for while the body comes in
+
+	FastCGIConnection *_fcgi; // fastcgi_pass or a cgi_workers pool, the connection running the request
+	bool _queued; // waiting for a busy cgi_workers pool, see CGIWorkerPool::wait()
 
 	time_t expires_at;
 
 	//void init_(HTTPParser &parser, RouteMatch const &match);
+	void buildEnv(HTTPParser &parser, std::vector<std::string> &envStrings);
 	void initEnv(HTTPParser &parser);
 	void initArgv(RouteMatch const &match);
+	// false if 'upstream' has no connection to give
+	bool startFastCGI(FastCGIUpstream &upstream);
+
+	// the script's output (a CGI response) turned into ours, whether it
+	// comes from the pipe or from FastCGI stdout records. false on a
+	// malformed or truncated response, 'status' is set then
+	bool relayOutput(const char *data, size_t size);
+	bool relayEnd();
+
+	// the body as it's received, stdin gets EOF once it's complete
+	void _writeBody();
+	void _closeInput();
+	void _watchClient();
+	bool _inputOpen() const;
 
 public:
-	CGIHandler(HTTPParser &parser, HTTPResponse &response, ServerConfig &config, FdManager &fdm);
+	CGIHandler(HTTPParser &parser, HTTPResponse &response, ServerConfig &config, FdManager &fdm, int clientFd);
 	~CGIHandler();
 	int get_fd();
 	int getStatus();
 	void start(const RouteMatch &match, bool body_availelbe);
+	// more of the body is in the request's ring
+	void feedBody();
 	void destroy();
 	void onEvent(uint32_t events);
 	void onReadable();
@@ -70,7 +103,19 @@ public:
 	void onTimeout();
 	bool isRunning() const;
 	void end();
+	// the request is given up on, 'code' is what the client gets instead
+	void abort(int code);
 	void reset();
+	// the output is read again once the client caught up, see HTTPResponse::isFull()
+	void resume();
+
+	void onFcgiOutput(const char *data, size_t size);
+	void onFcgiEnd(int appStatus);
+	void onFcgiError(int status);
+	void onFcgiBodySent();
+	void onFcgiReady();
+
+	void onChildExit(ChildProcess *child, int waitStatus);
 };
 
 #endif // CGI_HANDLER_HPP
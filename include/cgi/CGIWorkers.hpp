@@ -0,0 +1,125 @@
+#ifndef WEBSERV_CGIWORKERS_HPP
+#define WEBSERV_CGIWORKERS_HPP
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <sys/types.h>
+
+#include "FastCGI.hpp"
+#include "ChildProcess.hpp"
+
+#define CGI_WORKER_REQUESTS 1000    // requests before a worker is replaced
+#define CGI_WORKER_IDLE     60      // seconds an idle worker above the minimum is kept
+#define CGI_WORKER_QUEUE    64      // requests waiting for a busy pool, more get a 503
+#define CGI_WORKER_BACKOFF  32      // most seconds between two starts of a failing worker
+#define CGI_WORKER_STARTUP  2       // seconds a worker has to serve something, or it failed
+
+class CGIWorkerPool;
+
+// wakes a pool up from the event loop, never from inside a connection's
+// callback: an eventfd, and a timeout for the end of a backoff
+class CGIWorkerBell : public EventHandler
+{
+    int             _fd;
+    CGIWorkerPool&  _pool;
+
+public:
+    CGIWorkerBell(int fd, CGIWorkerPool& pool, FdManager& fdm);
+    ~CGIWorkerBell();
+
+    void    ring();
+    void    wakeAt(time_t when);
+
+    int     get_fd();
+    void    destroy();
+    void    onEvent(uint32_t events);
+};
+
+/*
+    long lived processes running one CGI script, instead of a fork + exec
+    per request. a worker gets its end of a socketpair as stdin and speaks
+    FastCGI on it, through a runner that loads the interpreter once and runs
+    the script for each request (scripts/cgi_worker.py), so our side is the
+    FastCGIConnection of fastcgi_pass. 'min' workers are started with the
+    server and always kept, more are started on demand up to 'max'. a worker
+    is replaced after 'maxRequests' requests, one idle for 'idleTimeout'
+    seconds is stopped while there are more than 'min'.
+    with all 'max' busy a request waits for one in a bounded queue. a worker
+    gone unused right after its start failed: the next one is started after
+    a delay that doubles each time, up to CGI_WORKER_BACKOFF seconds.
+*/
+class CGIWorkerPool : public FastCGIUpstream, public ChildWatcher
+{
+    friend class CGIWorkerBell;
+
+    struct worker
+    {
+        ChildProcess*   process;    // NULL once it exited
+        size_t          requests;
+        time_t          started;
+    };
+    typedef std::map<FastCGIConnection*, worker> workers_t;
+
+    std::vector<std::string>    _argv;      // [interpreter] runner script
+    std::string                 _path;      // PATH of the worker's environment
+    size_t                      _min;
+    size_t                      _max;
+    size_t                      _maxRequests;
+    time_t                      _idleTimeout;
+    workers_t                   _workers;
+    std::list<FastCGIClient*>   _queue;     // waiting for a worker, oldest first
+    CGIWorkerBell*              _bell;      // NULL until start()
+    size_t                      _failures;  // workers in a row that died unused
+    time_t                      _retryAt;   // no worker is started before
+
+    FastCGIConnection*  _spawn(const ServerConfig& config, FdManager& fdm);
+    void                _fill(const ServerConfig& config, FdManager& fdm);
+    bool                _canSpawn() const;
+    void                _failed();
+    void                _ring();
+
+public:
+    explicit CGIWorkerPool(const Location& loc);
+
+    // the first 'min' workers, once there's an event loop
+    void    start(FdManager& fdm);
+
+    // false without a runner to start, requests get a process of their own
+    bool                usable() const;
+    // an idle worker or a new one, NULL when all 'max' are busy
+    FastCGIConnection*  acquire(const ServerConfig& config, FdManager& fdm);
+    // queues a request acquire() had nothing for, false (503) when the queue
+    // is full or no worker can run. the client is told with onFcgiReady()
+    bool                wait(FastCGIClient* client);
+    void                cancel(FastCGIClient* client);
+    // the waiting requests get the workers that freed up, from the bell
+    void                dispatch();
+    // false once the worker served its last request
+    bool                release(FastCGIConnection* conn);
+    // the worker is stopped with its connection
+    void                forget(FastCGIConnection* conn);
+    bool                keepIdle(FastCGIConnection* conn);
+    time_t              idleTimeout() const;
+    // a worker died on its own, its connection is closed by the EOF
+    void                onChildExit(ChildProcess* child, int status);
+
+    // the pools are shared by the locations running the same command
+    static std::string  key(const Location& loc);
+};
+
+// every cgi_workers location of the config, pools live for good
+class CGIWorkers
+{
+    std::map<std::string, CGIWorkerPool*> _pools;
+
+public:
+    ~CGIWorkers();
+    CGIWorkerPool&  get(const Location& loc);
+    void            start(FdManager& fdm);
+};
+
+extern CGIWorkers cgiWorkers;
+
+#endif
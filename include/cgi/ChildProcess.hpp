@@ -0,0 +1,67 @@
+#ifndef WEBSERV_CHILDPROCESS_HPP
+#define WEBSERV_CHILDPROCESS_HPP
+
+#include <sys/types.h>
+
+#include "EventHandler.hpp"
+#include "FdManager.hpp"
+
+#define CHILD_KILL_DELAY    2   // seconds between SIGTERM and SIGKILL
+
+class ChildProcess;
+
+// the side waiting on a child's exit, see CGIHandler and CGIWorkerPool
+class ChildWatcher
+{
+public:
+    virtual ~ChildWatcher() {}
+
+    // reaped, 'status' is what waitpid() gave. the ChildProcess is gone
+    // once this returns
+    virtual void    onChildExit(ChildProcess* child, int status) = 0;
+};
+
+/*
+    a process we started, watched through a pidfd registered like any other
+    fd: it's readable once the process exited, which is reaped then without
+    ever blocking the loop. stop() sends SIGTERM, and SIGKILL from the
+    timeout if the process is still there CHILD_KILL_DELAY seconds later,
+    to its whole process group (see spawnProcess()).
+    it deletes itself when it's removed from the FdManager, that's after the
+    exit, or at shutdown where a child still running is killed and waited for.
+    without pidfd_open() (before linux 5.3) the process is polled each second.
+*/
+class ChildProcess : public EventHandler
+{
+    pid_t           _pid;
+    int             _fd;
+    bool            _polling;   // _fd is a placeholder, no pidfd
+    time_t          _killAt;    // when SIGKILL is due, 0 until stop()
+    bool            _killed;
+    ChildWatcher*   _watcher;   // NULL once detached
+
+    ChildProcess(pid_t pid, int fd, bool polling, ChildWatcher* watcher,
+                 const ServerConfig& config, FdManager& fdm);
+    bool    _reap();
+
+public:
+    ~ChildProcess();
+
+    // NULL if neither a pidfd nor a placeholder fd can be had, the process
+    // is killed then
+    static ChildProcess*    watch(pid_t pid, ChildWatcher* watcher,
+                                  const ServerConfig& config, FdManager& fdm);
+
+    // the watcher isn't told anything anymore, the process is still reaped
+    void    detach();
+    // detach() and end the process, TERM then KILL
+    void    stop();
+    pid_t   pid() const;
+
+    int     get_fd();
+    void    destroy();
+    void    onEvent(uint32_t events);
+    void    onTimeout();
+};
+
+#endif
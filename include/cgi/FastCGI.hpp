@@ -0,0 +1,173 @@
+#ifndef WEBSERV_FASTCGI_HPP
+#define WEBSERV_FASTCGI_HPP
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "EventHandler.hpp"
+#include "FdManager.hpp"
+#include "RingBuffer.hpp"
+
+// FastCGI 1.0, https://fastcgi-archives.github.io/FastCGI_Specification.html
+#define FCGI_VERSION_1          1
+#define FCGI_HEADER_LEN         8
+#define FCGI_MAX_CONTENT        65535
+
+#define FCGI_BEGIN_REQUEST      1
+#define FCGI_ABORT_REQUEST      2
+#define FCGI_END_REQUEST        3
+#define FCGI_PARAMS             4
+#define FCGI_STDIN              5
+#define FCGI_STDOUT             6
+#define FCGI_STDERR             7
+
+#define FCGI_RESPONDER          1
+#define FCGI_KEEP_CONN          1
+#define FCGI_REQUEST_COMPLETE   0
+
+#define FASTCGI_KEEPALIVE       16  // idle connections kept per upstream
+#define FASTCGI_IDLE_TIMEOUT    60  // seconds before an idle connection is closed
+#define FASTCGI_READ_SIZE       4096
+#define FASTCGI_STDIN_QUEUE     8192    // body bytes queued ahead of the socket
+
+// the side of a request waiting on the application, see CGIHandler
+class FastCGIClient
+{
+public:
+    virtual ~FastCGIClient() {}
+
+    // a piece of FCGI_STDOUT, the same bytes a CGI writes to its stdout
+    virtual void    onFcgiOutput(const char* data, size_t size) = 0;
+    // some of the body was taken from its ring, there's room for more
+    virtual void    onFcgiBodySent() = 0;
+    // FCGI_END_REQUEST, the connection has been handed back to the pool
+    virtual void    onFcgiEnd(int appStatus) = 0;
+    // the connection failed or timed out (502/504), it's gone
+    virtual void    onFcgiError(int status) = 0;
+    // a worker freed up for the request queued with CGIWorkerPool::wait()
+    virtual void    onFcgiReady() = 0;
+};
+
+class FastCGIUpstream;
+
+/*
+    one socket to the application. it carries a single request at a time
+    and with FCGI_KEEP_CONN stays open for the next one: the request id is
+    always 1. its fd is registered in the FdManager like any other, and it
+    deletes itself when it's removed from there.
+*/
+class FastCGIConnection : public EventHandler
+{
+    int                 _fd;
+    FastCGIUpstream&    _upstream;
+    FastCGIClient*      _client;        // NULL while idle
+    bool                _connected;
+    time_t              _timeout;       // of the running request
+
+    std::string         _out;           // records not written yet
+    size_t              _outSent;
+    RingBuffer*         _stdin;         // the request body, NULL once it's all queued
+    bool                _stdinLast;     // nothing more comes into it
+    std::string         _in;            // what's left of the last read
+    size_t              _stdoutLeft;    // of the stdout record being relayed
+    size_t              _skipLeft;      // padding, or a record that isn't ours
+
+    bool                _dispatching;   // inside a client callback
+    bool                _paused;        // stdout isn't read, the client is behind
+    bool                _closing;       // aborted from there, closed once it returns
+
+    void    _record(int type, const char* data, size_t size);
+    void    _params(const std::vector<std::string>& params);
+    // false once the connection is gone (deleted), the same for _writable()
+    bool    _flush();
+    void    _fillStdin();
+    void    _watch();
+    bool    _writable();
+    void    _parse();
+    void    _finish(int appStatus);
+    void    _fail(int status);
+
+public:
+    FastCGIConnection(int fd, bool connected, FastCGIUpstream& upstream,
+                      const ServerConfig& config, FdManager& fdm);
+    ~FastCGIConnection();
+
+    // queues the request: the params ("NAME=value", like a CGI environment),
+    // then the body ring's content as stdin, taken from it as it's sent.
+    // no body, and stdin ends right away
+    void    begin(FastCGIClient* client, const std::vector<std::string>& params,
+                  RingBuffer* body, time_t timeout);
+    // more of the body is in the ring, 'last' once it's complete
+    void    feedStdin(bool last);
+    // the client is gone, the connection can't be reused
+    void    abort();
+    // stdout stops being handed to the client until resume(), the
+    // application blocks on a full socket meanwhile
+    void    pause();
+    void    resume();
+    bool    isIdle() const;
+
+    int     get_fd();
+    void    destroy();
+    void    onEvent(uint32_t events);
+    void    onReadable();
+    void    onWritable();
+    void    onError();
+    void    onTimeout();
+};
+
+/*
+    an application address, "unix:/run/app.sock" or "host:port", and the
+    connections to it that are kept alive between requests.
+*/
+class FastCGIUpstream
+{
+    struct sockaddr_storage         _addr;
+    socklen_t                       _addrLen;   // 0 if the address can't be used
+
+protected:
+    std::string                     _address;
+    std::list<FastCGIConnection*>   _idle;      // most recently used first
+
+    // no address to connect to, the connections are made by a subclass
+    FastCGIUpstream();
+
+public:
+    // throws if 'address' can't be resolved
+    explicit FastCGIUpstream(const std::string& address);
+    virtual ~FastCGIUpstream() {}
+
+    // an idle connection or a new one (connecting), NULL if the socket fails
+    virtual FastCGIConnection*  acquire(const ServerConfig& config, FdManager& fdm);
+    // back to the pool once a request ended, false if the pool is full
+    virtual bool                release(FastCGIConnection* conn);
+    // the connection is closing, forget it
+    virtual void                forget(FastCGIConnection* conn);
+    // an idle connection timed out, true to keep it anyway
+    virtual bool                keepIdle(FastCGIConnection* conn);
+    // seconds an idle connection is kept
+    virtual time_t              idleTimeout() const;
+
+    const std::string&  address() const;
+
+    // true if 'address' is either form, for the config parser
+    static bool isValidAddress(const std::string& address);
+};
+
+// every fastcgi_pass address of the config, upstreams live for good
+class FastCGIPool
+{
+    std::map<std::string, FastCGIUpstream*> _upstreams;
+
+public:
+    ~FastCGIPool();
+    FastCGIUpstream&    get(const std::string& address);
+};
+
+extern FastCGIPool fastcgiPool;
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef WEBSERV_SPAWN_HPP
+#define WEBSERV_SPAWN_HPP
+
+#include <sys/types.h>
+
+/*
+    starts argv[0] with 'in' and 'out' as its stdin and stdout, stderr is
+    ours. posix_spawn() runs the child in our memory until its exec (like
+    vfork), so unlike fork() the cost doesn't grow with the server's size:
+    no page tables are copied. every other fd is closed in the child, the
+    signals we ignore (SIGPIPE) get their default action back, and it leads
+    a process group of its own.
+    -1 with errno set if the program couldn't be started.
+*/
+pid_t   spawnProcess(char* const argv[], char* const envp[], int in, int out);
+
+#endif
@@ -5,6 +5,8 @@
 #include <string>
 #include <map>
 
+#include "ContentCache.hpp"
+
 // global map holding default HTML pages for common HTTP errors
 extern std::map<int, std::string> defaultErrorPages;
 
@@ -13,4 +15,12 @@ const std::string getErrorPage(int code);
 
 void initErrorPages();
 
+// an error page rendered like a cached file: its headers, the blank line and
+// the page, only the status line and the Date are written per response
+contentPtr renderErrorPage(const std::string &page, const std::string &type);
+
+// the built-in page for 'code' as a response, rendered once and shared by
+// every server block
+contentPtr getErrorResponse(int code);
+
 #endif
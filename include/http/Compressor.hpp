@@ -0,0 +1,64 @@
+#ifndef WEBSERV_COMPRESSOR_HPP
+#define WEBSERV_COMPRESSOR_HPP
+
+#include <string>
+#include <zlib.h>
+
+#include "ConfigParser.hpp"
+
+#define GZIP_COMP_LEVEL     1   // fastest, dynamic output is compressed on every request
+#define GZIP_MIN_LENGTH     20  // smaller known-length bodies aren't worth it
+#define GZIP_DEFAULT_TYPE   "text/html"
+
+enum coding_t
+{
+    CODING_NONE,
+    CODING_GZIP,
+    CODING_DEFLATE
+};
+
+// RFC 9110 12.5.3, true if 'coding' is listed (or covered by '*') without q=0
+bool        acceptsEncoding(const std::string& header, const char* coding);
+
+// the coding a dynamic response of 'type' should be sent with, 'length' is
+// -1 when unknown. CODING_NONE if gzip is off, the type isn't listed in
+// gzip_types, the body is too short or the client doesn't accept it
+coding_t    negotiateCoding(const Location& loc, const std::string& acceptEncoding,
+                            const std::string& type, long length);
+bool        isCompressible(const Location& loc, const std::string& type);
+const char* codingName(coding_t coding);
+
+/*
+    a zlib deflate stream, fed as the body is produced. nothing is ever held
+    back on purpose: every write() is sync flushed so a slow CGI still reaches
+    the client piece by piece, only the compressed bytes are kept in memory.
+*/
+class Compressor
+{
+    z_stream    _zs;
+    bool        _active;
+    bool        _finished;
+    int         _flush;
+
+    Compressor(const Compressor&);
+    Compressor& operator=(const Compressor&);
+
+public:
+    Compressor();
+    ~Compressor();
+
+    bool    start(coding_t coding, int level);
+    bool    isActive() const;
+
+    // queue the next input, 'last' once the body is complete
+    void    write(const char* data, size_t size, bool last);
+    // compressed output for what was written so far, 0 once drained
+    size_t  read(char* buff, size_t size);
+
+    void    reset();
+
+    // the whole of 'in' at once, for bodies already in memory
+    static bool compress(coding_t coding, int level, const std::string& in, std::string& out);
+};
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef WEBSERV_DIRLISTING_HPP
+#define WEBSERV_DIRLISTING_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <sys/stat.h>
+
+#include "FileCache.hpp"
+#include "ContentCache.hpp"
+
+#define DIR_CACHE_MAX   64  // directories
+
+// what an autoindex is rendered as
+enum autoindexFormat
+{
+    AUTOINDEX_HTML,
+    AUTOINDEX_JSON
+};
+
+struct dirEntry
+{
+    std::string name;
+    bool        isDir;
+    off_t       size;
+    time_t      mtime;
+
+    // directories first, then by name
+    bool operator<(const dirEntry& other) const;
+};
+
+/*
+    the rows of a listing rendered once, row i is data[offsets[i], offsets[i + 1]).
+    a page of the listing is a single slice of 'rows', sent from where it is.
+*/
+struct dirRows
+{
+    contentPtr          rows;
+    std::vector<size_t> offsets;    // entries + 1 of them
+};
+
+/*
+    a directory read once (readdir + fstatat), kept as long as its inode and
+    mtime don't change. adding, removing or renaming an entry bumps the mtime,
+    changes to the files themselves are caught by the FileWatcher.
+*/
+struct CachedDir
+{
+    std::vector<dirEntry>   entries;    // sorted
+    ino_t                   ino;
+    time_t                  mtime;
+    long                    mtimeNsec;
+
+    bool            matches(const struct stat& st) const;
+    // rendered on first use, for every page and every request after that
+    const dirRows&  rows(autoindexFormat format);
+
+private:
+    dirRows _html;
+    dirRows _json;
+};
+
+typedef sharedPtr<CachedDir> dirPtr;
+
+/*
+    LRU of read directories keyed by path, the listings of a busy index are
+    served without a readdir() or a stat() per entry.
+*/
+class DirCache
+{
+    typedef std::list<std::string>  lru_t;
+
+    struct node
+    {
+        dirPtr          dir;
+        lru_t::iterator pos;
+    };
+    typedef std::map<std::string, node> map_t;
+
+    map_t   _entries;
+    lru_t   _lru;           // most recently used first
+    size_t  _maxEntries;    // 0 disables the cache
+
+    void    _evict(map_t::iterator it);
+    dirPtr  _read(const CachedFile& dir);
+
+public:
+    DirCache();
+
+    // NULL if the directory can't be read
+    dirPtr  get(const filePtr& dir);
+    void    invalidate(const std::string& path);
+    void    clear();
+
+    void    setMaxEntries(size_t max);
+};
+
+// process wide cache, filled by RequestHandler::_sendListing
+extern DirCache dirCache;
+
+// the constant part of an html listing, up to the per request <title>
+extern const char   autoindexPrelude[];
+extern const size_t autoindexPreludeSize;
+
+// "<>&\"'" as entities, for text and attribute values
+std::string htmlEscape(const std::string& s);
+// everything but unreserved characters percent-encoded, for a path segment
+std::string uriEscape(const std::string& s);
+// '"', '\\' and control characters escaped for a JSON string
+std::string jsonEscape(const std::string& s);
+
+#endif
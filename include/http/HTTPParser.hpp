@@ -63,6 +63,7 @@ class HTTPParser
     std::string _query;
     std::string _fragment;
     std::string _version;
+    bool        _uriRewritten;  // '//', '.' or '..' were taken out of the path
     strmap      _headers;
 
     // the requst body (default for now)
@@ -114,6 +115,8 @@ public:
     std::string&    getQuery(void);
     std::string&    getFragment(void);
     std::string&    getVers(void);
+    // the client didn't send the path in its normal form, see _decodeURI()
+    bool            isUriRewritten(void);
 
     strmap&         getHeaders(void);
     std::string&    getHeader(const std::string& key);
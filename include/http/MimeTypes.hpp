@@ -0,0 +1,46 @@
+#ifndef WEBSERV_MIMETYPES_HPP
+#define WEBSERV_MIMETYPES_HPP
+
+#include <string>
+#include <vector>
+
+#define DEFAULT_MIME_TYPE "application/octet-stream"
+
+/*
+    extension -> content type, an open addressing hash table keyed by the
+    lowercased extension (without the dot). it's filled once at startup,
+    either with the built-in list or with the config 'types { }' block.
+*/
+class MimeTypes
+{
+    struct entry
+    {
+        std::string ext;
+        std::string type;
+    };
+
+    std::vector<entry>  _table;     // size is always a power of two
+    size_t              _count;
+    const std::string   _default;
+
+    static size_t   _hash(const char* ext, size_t len);
+    size_t          _slot(const char* ext, size_t len) const;
+    void            _grow();
+
+public:
+    MimeTypes();
+
+    void    add(const std::string& ext, const std::string& type);
+    void    clear();
+    size_t  size() const;
+
+    // type of a raw extension (no dot), case insensitive
+    const std::string&  find(const char* ext, size_t len) const;
+    // type of a file, resolved from whatever follows the last '.' of its name
+    const std::string&  lookup(const std::string& path) const;
+};
+
+// process wide registry, the config 'types' block replaces the built-in list
+extern MimeTypes mimeTypes;
+
+#endif
@@ -1,15 +1,18 @@
 #ifndef WEBSERV_REQ_HANDLER
 #define WEBSERV_REQ_HANDLER
 
-#include <dirent.h>
-
 #include "HTTPParser.hpp"
 #include "Response.hpp"
 #include "Routing.hpp"
 #include "Logger.hpp"
 #include "SpecialResponse.hpp"
+#include "Compressor.hpp"
+#include "DirListing.hpp"
+#include "VirtualHosts.hpp"
 #include "../cgi/CGIHandler.hpp"
 
+#define MAX_RANGES 16 // more than that and the whole file is sent instead
+
 // the current methods we are required to handle
 // static const char* methods[] = { "GET", "POST", "DELETE" };
 
@@ -17,16 +20,27 @@ class RequestHandler
 {
     Logger  logger;
 
+    VirtualHosts    &_hosts;
     Routing         _router;
+    RouteMatch      _match;     // routed once per request, see _route()
+    bool            _isRouted;
+    RouteMatch      _tryMatch;  // what try_files picked, once per request too
+    int             _tryStatus; // or the error it ended with, 0 if none
+    bool            _isTried;
     HTTPParser      &_request;
     HTTPResponse    &_response;
 
     CGIHandler      _cgi;
 	time_t			_cgiSrtartTime;
+    bool            _cgiStarted;    // the rest of the body is streamed to it
 
     bool            _keepAlive;
     bool            _isCGI;
     bool            _isDirSet;
+    bool            _expectChecked;
+    bool            _sendContinue;
+
+    const RouteMatch&   _route();
 
     void    _common(const RouteMatch& match);
     // i wanted to use an iteface for this, but it's overkill
@@ -38,29 +52,20 @@ class RequestHandler
     // helper methods
     void        _sendErrorResponse(int code);
     void        _serveFile(const RouteMatch& path);
+    void        _sendFile(const filePtr& file, bool gzipStatic);
+    filePtr     _findPrecompressed(const filePtr& file, const char*& encoding);
+    bool        _isNotModified(const CachedFile& file);
+    int         _parseRanges(const CachedFile& file, ranges_t& ranges);
     void        _serveDict(const RouteMatch& match);
-    std::string _getDictListing(const std::string& path);
+    void        _tryFiles(const RouteMatch& match);
+    void        _resolveTryFiles(const RouteMatch& match);
+    bool        _sendListing(const RouteMatch& match);
 
     void        _handleCGI(const RouteMatch& match);
-
-    struct fileInfo
-    {
-        std::string name;
-        struct stat data;
-        bool operator<(const fileInfo& other) const
-        {
-            bool thisIsDir = S_ISDIR(data.st_mode);
-            bool otherIsDir = S_ISDIR(other.data.st_mode);
-
-            if (thisIsDir != otherIsDir)
-                return thisIsDir > otherIsDir;
-
-            return name < other.name;
-        }
-    };
+    int         _checkExpectation(const RouteMatch& match);
 
 public:
-    RequestHandler(ServerConfig &config, HTTPParser& req, HTTPResponse& resp, FdManager &fdManager);
+    RequestHandler(VirtualHosts &hosts, HTTPParser& req, HTTPResponse& resp, FdManager &fdManager, int clientFd);
     ~RequestHandler();
 
     void    feed(char* buff, size_t size);
@@ -75,9 +80,14 @@ public:
 
     void    setError(int code);
 
+    // true once if the client is waiting for an interim '100 Continue'
+    bool    shouldSendContinue();
+
     // return true if response is ready to be sent
     bool    processRequest();
     size_t  readNextChunk(char* buff, size_t size);
+    // after each send, a CGI output paused on a full response goes on
+    void    resumeCGI();
 
     void    reset();
 };
@@ -9,27 +9,76 @@
 #include <errno.h>
 #include <cstring>
 #include <sstream>
+#include <ctime>
+#include <sys/uio.h>
 #include "Routing.hpp"
 #include "RingBuffer.hpp"
+#include "MimeTypes.hpp"
+#include "ContentCache.hpp"
+#include "Compressor.hpp"
 
 // helper macro to stringify values
 #define SSTR(x) static_cast<std::ostringstream &>((std::ostringstream() << x)).str()
 
 #define BUFF_SIZE 8192 // 8 KB buffer
+// a streamed body (CGI, FastCGI) stops being read past the high-water mark
+// and goes on below the low one, one read always fits in between
+#define RESPONSE_HIGH_WATER BUFF_SIZE
+#define RESPONSE_LOW_WATER  (BUFF_SIZE / 2)
 #define CRLF "\r\n"
+#define SERVER_HEADER "Server: WebServ/1.0" CRLF
+
+// inclusive [first, last] byte offsets
+typedef std::vector<std::pair<off_t, off_t> > ranges_t;
+
+// one byte range of a file, 'head' goes out right before it
+struct filePart
+{
+    std::string head;
+    off_t       start;
+    size_t      size;
+};
+
+// a piece of body sent straight from memory, 'data' lives as long as 'owner'
+// (or for good, a constant)
+struct memSegment
+{
+    const char* data;
+    size_t      size;
+    contentPtr  owner;
+};
 
 class HTTPResponse
 {
     std::string _version;
     RingBuffer  _response;   // headers + optional small body
 
-    int     _file_fd;       // file descriptor (if serving file)
-    size_t  _file_size;     // total file size
-    size_t  _bytes_sent;    // bytes sent from file
+    filePtr _file;          // cached file (if serving file), its fd is shared
+    off_t   _file_start;    // where the segment being sent starts in the file
+    size_t  _file_size;     // size of that segment (the whole file by default)
+    size_t  _bytes_sent;    // bytes sent from it
+
+    std::vector<filePart>   _parts; // multipart/byteranges, sent one after the other
+    size_t                  _next_part;
+
+    std::vector<memSegment> _segments;  // sent in order, after the buffer
+    size_t                  _segment;   // the one being sent
+    size_t                  _segment_sent;
+
+    Compressor  _compressor;    // chunked body filter, see compressBody()
+
+    int     _pipe;          // chunk being relayed from a CGI's stdout, see feedPipe()
+    size_t  _pipe_left;
     
     
-    const std::string _getContentType(const std::string &filepath);
-    const std::string _getStatus(int code);
+
+    bool    _nextPart();
+    void    _writeChunk(const char* data, size_t size);
+    void    _writeNumber(size_t n, unsigned base);
+    void    _writeHeader(const char* k, size_t klen, const char* v, size_t vlen);
+
+    static const char* _getStatusLine(int code, size_t& len);
+    static const char* _getDateHeader(size_t& len);
     public:
    // bool   _cgiComplete;
     HTTPResponse(const std::string& version);
@@ -38,6 +87,7 @@ class HTTPResponse
     void    startLine(int code);
 
     void addHeader(const std::string &name, const std::string &value);
+    void addHeader(const std::string &name, size_t value);
     void endHeaders();
 
     // set body directly (for small responses)
@@ -49,11 +99,52 @@ class HTTPResponse
     void feedRAW(const char* data, size_t size);
     void feedRAW(const std::string& data);
 
+    // the next 'size' bytes waiting in the pipe 'fd' go out as one chunk,
+    // moved to the socket by the sender without being read by us
+    void feedPipe(int fd, size_t size);
+    // the chunk left to relay, only once the buffer is drained, so the
+    // caller can hand it to splice()
+    size_t peekPipe(int &fd) const;
+    void   consumePipe(size_t size);
+    bool   pipePending() const;
+
+    bool isCompressing() const;
+    // see RESPONSE_HIGH_WATER, the buffer overwrites its oldest bytes once full
+    bool isFull() const;
+    bool isDrained() const;
+
+    // compress what goes through feedRAW from now on, adds the Content-Encoding
+    // header so it has to come before endHeaders()
+    bool compressBody(coding_t coding, int level);
+
     // serve file as body (sets Content-Length automatically)
     // this behavoir might change if we plan to support 'chunekd transfer'
-    bool attachFile(const std::string &filepath);
+    bool attachFile(const filePtr &file);
+    bool attachFile(const filePtr &file, const std::string &type);
     void closeFile();
 
+    // 206 bodies, ranges are inclusive [first, last] byte offsets
+    bool attachRange(const filePtr &file, const std::string &type, off_t first, off_t last);
+    bool attachRanges(const filePtr &file, const std::string &type, const ranges_t &ranges);
+
+    // the file segment left to send, only once the buffer is drained,
+    // so the caller can hand it to sendfile()
+    size_t peekFile(int &fd, off_t &offset);
+    void   consumeFile(size_t size);
+
+    // serve a cached response, right after the status line
+    void attachContent(const contentPtr &content);
+    // queue body bytes that are sent from where they are, see memSegment
+    void attachSegment(const char *data, size_t size, const contentPtr &owner = contentPtr());
+    bool hasContent() const;
+
+    // zero copy access for the sender: the pending head of the buffer
+    // is copied into 'buff', the in-memory segments are pointed to
+    size_t peekHead(char *buff, size_t size);
+    size_t peekContent(const char *&data) const;
+    size_t peekContent(struct iovec *iov, size_t count) const;
+    void   consume(size_t size);
+
     // write next chunk of data into buffer
     ssize_t readNextChunk(char *buffer, size_t buffer_size);
 
@@ -2,6 +2,7 @@
 #define WEBSERV_CLIENT_HPP
 
 #define DEFAULT_CLIENT_TIMEOUT 7
+#define MAX_SEGMENTS 8 // in-memory body pieces handed to one writev()
 
 #include "EventHandler.hpp"
 #include "FdManager.hpp"
@@ -12,6 +13,9 @@
 #include "Logger.hpp"
 #include "RequestHandler.hpp"
 #include <time.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
 
 enum ClientState
 {
@@ -36,6 +40,9 @@ class Client : public EventHandler
 
     char _readBuff[BUFF_SIZE];
     char _sendBuff[BUFF_SIZE];
+    size_t _sendLen; // bytes of _sendBuff to send, a partial send leaves some
+    size_t _sendOff;
+    bool _interim; // what's in _sendBuff is the rest of a 100 Continue
 
     std::string _strFD;
     ClientState _state;
@@ -48,12 +55,18 @@ class Client : public EventHandler
 
     void _processError();
     void _processRequest();
+    void _sendContinue();
 
     bool _readData();
     bool _sendData();
+    bool _isSent();
+    bool _sendContent();
+    bool _sendBuffered();
+    bool _sendFile(int fd, off_t offset, size_t size);
+    bool _splice(int fd, size_t size);
 
 public:
-    Client(int socket_fd, ServerConfig &config, FdManager &fdm);
+    Client(int socket_fd, VirtualHosts &hosts, FdManager &fdm);
     ~Client();
 
     void reset();
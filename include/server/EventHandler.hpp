@@ -15,7 +15,7 @@ protected:
     virtual void _updateExpiresAt(time_t new_expires) { _expiresAt = new_expires; };
 
 public:
-    EventHandler(ServerConfig &config, FdManager &fdm, time_t expires_at);
+    EventHandler(const ServerConfig &config, FdManager &fdm, time_t expires_at);
     virtual ~EventHandler() {}
     virtual void onEvent(uint32_t events) = 0;
     virtual void destroy() { // evey handler implement it's own destroy
@@ -29,6 +29,6 @@ public:
     virtual time_t getExpiresAt() const { return _expiresAt; };
 };
 
-inline EventHandler::EventHandler(ServerConfig &config, FdManager &fdm, time_t expires_at) : _fd_manager(fdm), _config(config), _expiresAt(expires_at) {}
+inline EventHandler::EventHandler(const ServerConfig &config, FdManager &fdm, time_t expires_at) : _fd_manager(fdm), _config(config), _expiresAt(expires_at) {}
 
 #endif // EVENT_HANDLER_HPP
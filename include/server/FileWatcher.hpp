@@ -0,0 +1,36 @@
+#ifndef FILE_WATCHER_HPP
+#define FILE_WATCHER_HPP
+
+#include <map>
+#include <set>
+#include <string>
+#include <sys/inotify.h>
+#include "EventHandler.hpp"
+#include "FdManager.hpp"
+
+#define MAX_WATCHES 4096 // directories, inotify watches aren't recursive
+
+// drops cached files and pre-rendered responses as soon as they change on disk
+class FileWatcher : public EventHandler
+{
+private:
+    int _fd;
+    std::map<int, std::string> _dirs; // watch descriptor -> directory
+    std::set<std::string> _roots;     // what watch() was called with
+
+    void _watchTree(const std::string &dir);
+    void _invalidate(const std::string &path);
+    void _overflow();
+
+public:
+    FileWatcher(FdManager &fdm);
+    ~FileWatcher();
+    void watch(const std::string &root);
+    int get_fd();
+    void destroy();
+    void onEvent(uint32_t events);
+    void onReadable();
+    void onError();
+};
+
+#endif // FILE_WATCHER_HPP
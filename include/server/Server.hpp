@@ -4,14 +4,16 @@
 #include "EventHandler.hpp"
 #include "Socket.hpp"
 #include "../Config/ConfigParser.hpp"
+#include "VirtualHosts.hpp"
 
 class Server : public EventHandler
 {
 private:
     Socket _socket;
+    VirtualHosts &_hosts;   // every server block on this address
 
 public:
-    Server(ServerConfig &config, FdManager &fdm);
+    Server(VirtualHosts &hosts, FdManager &fdm);
     ~Server();
     int get_fd() const;
     void destroy();
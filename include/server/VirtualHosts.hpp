@@ -0,0 +1,50 @@
+#ifndef WEBSERV_VIRTUALHOSTS_HPP
+#define WEBSERV_VIRTUALHOSTS_HPP
+
+#include <string>
+#include <vector>
+
+#include "ConfigParser.hpp"
+
+/*
+    every server block listening on the same host:port, sharing one socket.
+    the Host header of each request picks the block: an exact server_name
+    first, then the longest "*.example.com" wildcard, then the first block
+    declared for the address. names live in an open addressing hash table
+    keyed by the lowercased name, wildcards are stored as ".example.com".
+*/
+class VirtualHosts
+{
+    struct entry
+    {
+        std::string     name;
+        ServerConfig*   server;     // NULL for a free slot
+
+        entry(): server(NULL) {}
+    };
+
+    std::vector<entry>          _table;     // size is always a power of two
+    size_t                      _count;
+    std::vector<ServerConfig*>  _servers;   // in config order, [0] is the default
+
+    static size_t   _hash(const char* name, size_t len);
+    size_t          _slot(const char* name, size_t len) const;
+    void            _grow();
+    void            _add(const std::string& name, ServerConfig* server);
+
+public:
+    const std::string   host;
+    const int           port;
+
+    VirtualHosts(const std::string& host, int port);
+
+    // the config must outlive the table, a name already taken is ignored
+    void    add(ServerConfig& server);
+
+    // the block for a Host header value ("Example.com:8080" works), the
+    // default one when nothing matches or the header is missing
+    ServerConfig&   find(const std::string& host) const;
+    ServerConfig&   getDefault() const;
+};
+
+#endif
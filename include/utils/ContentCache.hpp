@@ -0,0 +1,76 @@
+#ifndef WEBSERV_CONTENTCACHE_HPP
+#define WEBSERV_CONTENTCACHE_HPP
+
+#include <string>
+#include <map>
+#include <list>
+
+#include "FileCache.hpp"
+
+#define CONTENT_CACHE_SIZE      (16 * 1024 * 1024)  // memory budget, in bytes
+#define CONTENT_CACHE_MAX_FILE  (256 * 1024)        // bigger files are never cached
+
+/*
+    a small file rendered once as a response: every header that doesn't change
+    between requests, the blank line, then the body. the status line and the
+    Date header are written per response in front of it.
+*/
+struct CachedContent
+{
+    std::string data;
+    std::string type;   // Content-type it was rendered with
+
+    // the file this was rendered from, a mismatch means it changed on disk
+    ino_t       ino;
+    off_t       size;
+    time_t      mtime;
+    long        mtimeNsec;
+
+    bool    matches(const struct stat& st) const;
+};
+
+typedef sharedPtr<CachedContent> contentPtr;
+
+/*
+    LRU of pre-rendered responses for hot small files, bounded by a memory
+    budget. entries are checked against the (cached) stat of the file on every
+    hit, and dropped right away by the FileWatcher when the file changes.
+*/
+class ContentCache
+{
+    typedef std::list<std::string>  lru_t;
+
+    struct node
+    {
+        contentPtr      content;
+        lru_t::iterator pos;
+    };
+    typedef std::map<std::string, node> map_t;
+
+    map_t   _entries;
+    lru_t   _lru;           // most recently used first
+
+    size_t  _budget;        // 0 disables the cache
+    size_t  _used;
+    size_t  _maxFile;
+
+    void        _evict(map_t::iterator it);
+    contentPtr  _render(const CachedFile& file, const std::string& type);
+
+public:
+    ContentCache();
+
+    // NULL if the file can't (or shouldn't) be served from memory
+    contentPtr  get(const filePtr& file);
+    contentPtr  get(const filePtr& file, const std::string& type);
+    void        invalidate(const std::string& path);
+    void        clear();
+
+    void    setBudget(size_t bytes);
+    void    setMaxFile(size_t bytes);
+};
+
+// process wide cache, filled by RequestHandler::_serveFile
+extern ContentCache contentCache;
+
+#endif
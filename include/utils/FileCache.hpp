@@ -0,0 +1,110 @@
+#ifndef WEBSERV_FILECACHE_HPP
+#define WEBSERV_FILECACHE_HPP
+
+#include <string>
+#include <map>
+#include <list>
+#include <ctime>
+#include <sys/stat.h>
+
+#include "sharedPtr.hpp"
+
+#define FILE_CACHE_MAX      1000    // entries, at most a quarter of RLIMIT_NOFILE
+#define FILE_CACHE_VALID    5       // seconds before an entry is checked again
+
+#define HTTP_DATE_FORMAT    "%a, %d %b %Y %H:%M:%S GMT" // IMF-fixdate, RFC 9110 5.6.7
+
+/*
+    what we know about a path: one open() and one fstat(). paths under a
+    location root are opened relative to the root's directory fd with
+    openat2(RESOLVE_BENEATH), so the kernel only walks what's below the root
+    and nothing ("..", symlinks) can resolve outside of it.
+    the fd is shared by every response serving the file, so it must only be
+    read with an explicit offset (pread/sendfile), never with read().
+    it's closed when the last owner (cache or response) lets go of the entry.
+*/
+struct CachedFile
+{
+    std::string path;
+    struct stat st;
+    int         fd;         // -1 unless the path is a readable regular file
+    int         err;        // errno of the failed lookup, 0 if the path exists
+    std::string type;       // content type, resolved once from the extension
+    std::string etag;       // validators of regular files, derived from the stat
+    std::string lastModified;
+    time_t      checkedAt;
+
+    int         rootFd;     // the root the path was resolved beneath, -1 if none or not a directory
+    size_t      rootLen;    // length of that root at the start of 'path'
+
+    CachedFile(const std::string& path, int rootFd = -1, size_t rootLen = 0);
+    ~CachedFile();
+
+    bool    exists() const;
+    bool    isFile() const;
+    bool    isDirectory() const;
+
+    // opens the path again, beneath its root when it has one (O_CLOEXEC is implied)
+    int     open(int flags) const;
+    // removes the path, relative to its root when it has one
+    int     unlink() const;
+
+private:
+
+    CachedFile(const CachedFile&);
+    CachedFile& operator=(const CachedFile&);
+};
+
+typedef sharedPtr<CachedFile> filePtr;
+
+/*
+    an LRU of CachedFile keyed by the resolved path, the equivalent of nginx's
+    'open_file_cache': a hit costs no syscall until the entry is 'valid'
+    seconds old, then it's looked up again. a hit must come from the same
+    root, an entry asked for beneath another one is looked up again too.
+*/
+class FileCache
+{
+    typedef std::list<std::string>  lru_t;
+
+    struct node
+    {
+        filePtr         file;
+        lru_t::iterator pos;
+    };
+    typedef std::map<std::string, node> map_t;
+
+    map_t   _entries;
+    lru_t   _lru;           // most recently used first
+
+    std::map<std::string, int>  _roots; // O_PATH directory fds, open for good
+
+    size_t  _maxEntries;    // 0 disables the cache
+    time_t  _valid;
+    bool    _cacheErrors;   // keep failed lookups (ENOENT...) too
+
+    void    _evict(map_t::iterator it);
+
+public:
+    FileCache();
+    ~FileCache();
+
+    // 'path' must start with the root 'rootFd' was opened from, 'rootLen' long
+    filePtr get(const std::string& path, int rootFd = -1, size_t rootLen = 0);
+    // most entries that can be kept, each may hold an fd
+    static size_t   fdBudget();
+    // a directory fd to resolve paths beneath, -1 if 'dir' can't be opened
+    // (logged, paths below it won't be found then)
+    int     openRoot(const std::string& dir);
+    void    invalidate(const std::string& path);
+    void    clear();
+
+    void    setMaxEntries(size_t max);
+    void    setValid(time_t seconds);
+    void    setCacheErrors(bool b);
+};
+
+// process wide cache, shared by routing and responses
+extern FileCache fileCache;
+
+#endif
@@ -35,7 +35,10 @@ public:
 
     /// @brief Copy constructor (shares ownership)
     /// @param copy Shared pointer to copy from
-    sharedPtr<_T>(const sharedPtr<_T> &copy)
+    sharedPtr<_T>(const sharedPtr<_T> &copy):
+        _count(NULL),
+        _ptr(NULL),
+        _deleter(NULL)
     { *this = copy; }
 
     /// @brief Destructor (decrements reference count)
@@ -102,14 +105,17 @@ private:
     /// @brief Releases ownership and decrements reference count
     void _release(void) {
         if (!_count) return;
-        if (--(*_count) != 0) return;
-        if (_deleter)
-            _deleter(_ptr);
-        else
-            delete _ptr;
-        delete _count;
+        if (--(*_count) == 0)
+        {
+            if (_deleter)
+                _deleter(_ptr);
+            else
+                delete _ptr;
+            delete _count;
+        }
         _count = NULL;
         _ptr = NULL;
+        _deleter = NULL;
     }
 };
 
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""
+Runner for a cgi_workers pool: the interpreter (and whatever the script
+imports) is loaded once, then the CGI script given as argument runs once
+per request, the way it would as a process of its own: os.environ, stdin
+and stdout are the request's.
+
+Requests come as FastCGI records on fd 0, a socket connected to the server,
+one at a time. The runner exits when the server closes it.
+
+    cgi_pass ./test/cgi_scripts/hello.py
+    script_interpreter /usr/bin/python3
+    cgi_workers ./scripts/cgi_worker.py 2 8
+"""
+import io
+import os
+import runpy
+import socket
+import struct
+import sys
+import traceback
+
+FCGI_END_REQUEST = 3
+FCGI_PARAMS = 4
+FCGI_STDIN = 5
+FCGI_STDOUT = 6
+FCGI_MAX_CONTENT = 65535
+
+
+def read_exact(sock, size):
+    data = b""
+    while len(data) < size:
+        chunk = sock.recv(size - len(data))
+        if not chunk:
+            return None
+        data += chunk
+    return data
+
+
+def read_record(sock):
+    header = read_exact(sock, 8)
+    if header is None:
+        return None
+    _, rtype, rid, length, padding, _ = struct.unpack("!BBHHBB", header)
+    content = read_exact(sock, length + padding)
+    if content is None:
+        return None
+    return rtype, rid, content[:length]
+
+
+def write_record(sock, rtype, rid, data):
+    records = []
+    for pos in range(0, max(len(data), 1), FCGI_MAX_CONTENT):
+        chunk = data[pos:pos + FCGI_MAX_CONTENT]
+        padding = -len(chunk) % 8
+        records.append(struct.pack("!BBHHBB", 1, rtype, rid, len(chunk), padding, 0))
+        records.append(chunk + b"\0" * padding)
+    sock.sendall(b"".join(records))
+
+
+def decode_params(data):
+    params = {}
+    pos = 0
+    while pos < len(data):
+        lengths = []
+        for _ in range(2):
+            if data[pos] < 128:
+                lengths.append(data[pos])
+                pos += 1
+            else:
+                lengths.append(struct.unpack("!I", data[pos:pos + 4])[0] & 0x7FFFFFFF)
+                pos += 4
+        name = data[pos:pos + lengths[0]]
+        pos += lengths[0]
+        value = data[pos:pos + lengths[1]]
+        pos += lengths[1]
+        params[name.decode("latin-1")] = value.decode("latin-1")
+    return params
+
+
+def read_request(sock):
+    """(id, params, stdin) of the next request, None once the server is gone"""
+    rid, params, stdin = 1, b"", b""
+    while True:
+        record = read_record(sock)
+        if record is None:
+            return None
+        rtype, rid, content = record
+        if rtype == FCGI_PARAMS:
+            params += content
+        elif rtype == FCGI_STDIN:
+            if not content:
+                return rid, decode_params(params), stdin
+            stdin += content
+
+
+def run(script, params, stdin):
+    """the script's exit status and what it wrote to stdout"""
+    saved = sys.stdin, sys.stdout, sys.argv
+    out = io.BytesIO()
+    os.environ.clear()
+    os.environ.update(params)
+    sys.stdin = io.TextIOWrapper(io.BytesIO(stdin), encoding="utf-8", errors="surrogateescape")
+    sys.stdout = io.TextIOWrapper(out, encoding="utf-8", write_through=True)
+    sys.argv = [script]
+    status = 0
+    try:
+        runpy.run_path(script, run_name="__main__")
+    except SystemExit as e:
+        if isinstance(e.code, int):
+            status = e.code
+        elif e.code is not None:
+            status = 1
+    except Exception:
+        traceback.print_exc()
+        status = 1
+    finally:
+        sys.stdout.flush()
+        output = out.getvalue()
+        sys.stdin, sys.stdout, sys.argv = saved
+    return status, output
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write("usage: cgi_worker.py SCRIPT\n")
+        return 1
+    script = sys.argv[1]
+    sock = socket.socket(fileno=0)
+    # imports next to the script work like when it runs on its own
+    sys.path[0] = os.path.dirname(os.path.abspath(script))
+
+    while True:
+        request = read_request(sock)
+        if request is None:
+            return 0
+        rid, params, stdin = request
+        status, output = run(script, params, stdin)
+        if output:
+            write_record(sock, FCGI_STDOUT, rid, output)
+        write_record(sock, FCGI_STDOUT, rid, b"")
+        write_record(sock, FCGI_END_REQUEST, rid, struct.pack("!IB3x", status & 0xFFFFFFFF, 0))
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,4 +1,11 @@
 #include "ConfigParser.hpp"
+#include "MimeTypes.hpp"
+#include "FileCache.hpp"
+#include "ContentCache.hpp"
+#include "Compressor.hpp"
+#include "Logger.hpp"
+#include "FastCGI.hpp"
+#include "CGIWorkers.hpp"
 
 ServerConfig::ServerConfig()
 {
@@ -10,22 +17,56 @@ ServerConfig::ServerConfig()
     indexFiles.push_back("index.html");
     maxBody = 10485760;
     client_timeout = 60;
-    errors[400] = getErrorPage(400);
-    errors[403] = getErrorPage(403);
-    errors[404] = getErrorPage(404);
-    errors[500] = getErrorPage(500);
+}
+
+// an error_page that can't be read keeps the built-in page
+void ServerConfig::loadErrorPages()
+{
+    Logger logger;
+
+    errorPages.clear();
+    for (map<int, string>::iterator it = defaultErrorPages.begin(); it != defaultErrorPages.end(); ++it)
+        errorPages[it->first] = getErrorResponse(it->first);
+
+    for (map<int, string>::iterator it = errors.begin(); it != errors.end(); ++it)
+    {
+        ifstream file(it->second.c_str(), ios::binary);
+        ostringstream page;
+        if (!file.is_open() || !(page << file.rdbuf()))
+        {
+            logger.warning("Cannot read error page " + it->second + ", using the default one");
+            continue;
+        }
+        errorPages[it->first] = renderErrorPage(page.str(), mimeTypes.lookup(it->second));
+    }
 }
 
 Location::Location(ServerConfig server)
 {
     route = "";
+    type = ROUTE_PREFIX;
+    rootFd = -1;
     root = server.root;
     cgi = "";
+    fastcgi = "";
     scriptInterpreter = "";
     cgi_timeout = 1000;
+    cgi_worker = "";
+    cgi_workers_min = 0;
+    cgi_workers_max = 0;
+    cgi_worker_requests = CGI_WORKER_REQUESTS;
+    cgi_worker_idle = CGI_WORKER_IDLE;
+    workers = NULL;
     redirect = "";
     upload = "";
     autoindex = false;
+    autoindex_format = AUTOINDEX_HTML;
+    autoindex_page_size = 0;
+    gzip_static = false;
+    gzip = false;
+    gzip_types.push_back(GZIP_DEFAULT_TYPE);
+    gzip_min_length = GZIP_MIN_LENGTH;
+    gzip_comp_level = GZIP_COMP_LEVEL;
     methods.push_back("GET");
     maxBody = server.maxBody;
     client_timeout = server.client_timeout;
@@ -37,17 +78,6 @@ vector<ServerConfig> &WebConfigFile::getServers()
     return (_servers);
 }
 
-ServerConfig WebConfigFile::getServer(const string &name)
-{
-    for (size_t i = 0; i < _servers.size(); i++)
-    {
-        if (_servers[i].name == name)
-            return (_servers[i]);
-    }
-
-    return (ServerConfig());
-}
-
 void WebConfigFile::addServer(const ServerConfig &server)
 {
     _servers.push_back(server);
@@ -155,7 +185,27 @@ short handleLocation(string str, vector<string> &tokens, Location &locTmp, const
         throwSyntaxError(str, fname, lnNbr);
 
     if (tokens.size() == 2 && tokens[0] == "route")
+    {
+        if (tokens[1][0] != '/')
+            throwSyntaxError(str, fname, lnNbr);
         locTmp.route = tokens[1];
+        locTmp.type = ROUTE_PREFIX;
+    }
+
+    else if (tokens.size() == 3 && tokens[0] == "route" && tokens[1] == "=")
+    {
+        if (tokens[2][0] != '/')
+            throwSyntaxError(str, fname, lnNbr);
+        locTmp.route = tokens[2];
+        locTmp.type = ROUTE_EXACT;
+    }
+
+    else if (tokens.size() == 3 && tokens[0] == "route" && tokens[1] == "~")
+    {
+        if (!LocationTree::parseSuffix(tokens[2], locTmp.route))
+            throwSyntaxError(str, fname, lnNbr);
+        locTmp.type = ROUTE_SUFFIX;
+    }
 
     else if (tokens.size() == 2 && tokens[0] == "root")
         locTmp.root = tokens[1];
@@ -170,6 +220,57 @@ short handleLocation(string str, vector<string> &tokens, Location &locTmp, const
             throwSyntaxError(str, fname, lnNbr);
     }
 
+    else if (tokens.size() == 2 && tokens[0] == "autoindex_format")
+    {
+        if (tokens[1] == "html")
+            locTmp.autoindex_format = AUTOINDEX_HTML;
+        else if (tokens[1] == "json")
+            locTmp.autoindex_format = AUTOINDEX_JSON;
+        else
+            throwSyntaxError(str, fname, lnNbr);
+    }
+
+    else if (tokens.size() == 2 && tokens[0] == "autoindex_page_size")
+        locTmp.autoindex_page_size = myAtol(tokens[1], str, fname, lnNbr);
+
+    else if (tokens.size() == 2 && tokens[0] == "gzip_static")
+    {
+        if (tokens[1] == "on")
+            locTmp.gzip_static = true;
+        else if (tokens[1] == "off")
+            locTmp.gzip_static = false;
+        else
+            throwSyntaxError(str, fname, lnNbr);
+    }
+
+    else if (tokens.size() == 2 && tokens[0] == "gzip")
+    {
+        if (tokens[1] == "on")
+            locTmp.gzip = true;
+        else if (tokens[1] == "off")
+            locTmp.gzip = false;
+        else
+            throwSyntaxError(str, fname, lnNbr);
+    }
+
+    // text/html is always compressed once gzip is on
+    else if (tokens[0] == "gzip_types")
+    {
+        locTmp.gzip_types.assign(1, GZIP_DEFAULT_TYPE);
+        for (size_t i = 1; i < tokens.size(); i++)
+            locTmp.gzip_types.push_back(tokens[i]);
+    }
+
+    else if (tokens.size() == 2 && tokens[0] == "gzip_min_length")
+        locTmp.gzip_min_length = myAtol(tokens[1], str, fname, lnNbr);
+
+    else if (tokens.size() == 2 && tokens[0] == "gzip_comp_level")
+    {
+        locTmp.gzip_comp_level = myAtol(tokens[1], str, fname, lnNbr);
+        if (locTmp.gzip_comp_level < 1 || locTmp.gzip_comp_level > 9)
+            throwSyntaxError(str, fname, lnNbr);
+    }
+
     else if (tokens.size() == 2 && tokens[0] == "client_max_body_size")
         locTmp.maxBody = myAtol(tokens[1], str, fname, lnNbr);
 
@@ -185,12 +286,50 @@ short handleLocation(string str, vector<string> &tokens, Location &locTmp, const
     else if (tokens.size() == 2 && tokens[0] == "cgi_pass")
         locTmp.cgi = tokens[1];
 
+    else if (tokens.size() == 2 && tokens[0] == "fastcgi_pass")
+    {
+        if (!FastCGIUpstream::isValidAddress(tokens[1]))
+            throwSyntaxError(str, fname, lnNbr);
+        locTmp.fastcgi = tokens[1];
+        // resolved now rather than on the first request
+        try
+        {
+            fastcgiPool.get(tokens[1]);
+        }
+        catch (const std::exception &e)
+        {
+            ostringstream oss;
+            oss << "Webserv: " << e.what() << " in " << fname << " at line " << lnNbr;
+            throw(runtime_error(oss.str()));
+        }
+    }
+
     else if (tokens.size() == 2 && tokens[0] == "script_interpreter")
         locTmp.scriptInterpreter = tokens[1];
 
     else if (tokens.size() == 2 && tokens[0] == "cgi_timeout")
         locTmp.cgi_timeout = myAtol(tokens[1], str, fname, lnNbr);
 
+    // 'cgi_workers runner min max'
+    else if (tokens.size() == 4 && tokens[0] == "cgi_workers")
+    {
+        locTmp.cgi_worker = tokens[1];
+        locTmp.cgi_workers_min = myAtol(tokens[2], str, fname, lnNbr);
+        locTmp.cgi_workers_max = myAtol(tokens[3], str, fname, lnNbr);
+        if (locTmp.cgi_workers_max == 0 || locTmp.cgi_workers_min > locTmp.cgi_workers_max)
+            throwSyntaxError(str, fname, lnNbr);
+    }
+
+    else if (tokens.size() == 2 && tokens[0] == "cgi_worker_requests")
+    {
+        locTmp.cgi_worker_requests = myAtol(tokens[1], str, fname, lnNbr);
+        if (locTmp.cgi_worker_requests == 0)
+            throwSyntaxError(str, fname, lnNbr);
+    }
+
+    else if (tokens.size() == 2 && tokens[0] == "cgi_worker_idle")
+        locTmp.cgi_worker_idle = myAtol(tokens[1], str, fname, lnNbr);
+
     else if (tokens[0] == "index")
     {
         locTmp.indexFiles.clear();
@@ -205,6 +344,22 @@ short handleLocation(string str, vector<string> &tokens, Location &locTmp, const
         }
     }
 
+    // candidates, then the fallback: a uri routed again or '=code'
+    else if (tokens[0] == "try_files")
+    {
+        if (tokens.size() < 3)
+            throwSyntaxError(str, fname, lnNbr);
+        for (size_t i = 1; i < tokens.size(); i++)
+        {
+            if (tokens[i][0] != '/' && tokens[i][0] != '$' && tokens[i][0] != '=')
+                throwSyntaxError(str, fname, lnNbr);
+        }
+        const string& fallback = tokens.back();
+        if (fallback[0] == '=' && (fallback.size() != 4 || myAtol(fallback.substr(1), str, fname, lnNbr) < 100))
+            throwSyntaxError(str, fname, lnNbr);
+        locTmp.tryFiles.assign(tokens.begin() + 1, tokens.end());
+    }
+
     else if (tokens[0] == "methods")
     {
         locTmp.methods.clear();
@@ -248,8 +403,11 @@ short handleServer(string str, vector<string> &tokens, ServerConfig &srvTmp, con
             throwSyntaxError(str, fname, lnNbr);
     }
 
-    else if (tokens.size() == 2 && tokens[0] == "server_name")
+    else if (tokens[0] == "server_name")
+    {
         srvTmp.name = tokens[1];
+        srvTmp.names.assign(tokens.begin() + 1, tokens.end());
+    }
 
     else if (tokens.size() == 2 && tokens[0] == "root")
         srvTmp.root = tokens[1];
@@ -283,10 +441,71 @@ short handleServer(string str, vector<string> &tokens, ServerConfig &srvTmp, con
     return (0);
 }
 
+short handleTypes(string str, vector<string> &tokens, bool &typesSeen, const string &fname, size_t &lnNbr)
+{
+    // 'mime/type ext1 ext2 ...', a trailing ';' is accepted so nginx mime.types lines can be pasted
+    if (!tokens.empty() && tokens.back() == ";")
+        tokens.pop_back();
+    if (!tokens.empty() && tokens.back()[tokens.back().size() - 1] == ';')
+        tokens.back().erase(tokens.back().size() - 1);
+
+    if (tokens.size() < 2 || tokens[0].find('/') == string::npos)
+        throwSyntaxError(str, fname, lnNbr);
+
+    // the first block replaces the built-in list, later ones extend it
+    if (!typesSeen)
+    {
+        mimeTypes.clear();
+        typesSeen = true;
+    }
+    for (size_t i = 1; i < tokens.size(); i++)
+    {
+        if (tokens[i].empty())
+            throwSyntaxError(str, fname, lnNbr);
+        mimeTypes.add(tokens[i], tokens[0]);
+    }
+    return (0);
+}
+
+short handleMain(string str, vector<string> &tokens, const string &fname, size_t &lnNbr)
+{
+    if (tokens.size() != 2)
+        throwSyntaxError(str, fname, lnNbr);
+
+    if (tokens[0] == "open_file_cache")
+        fileCache.setMaxEntries(myAtol(tokens[1], str, fname, lnNbr));
+
+    else if (tokens[0] == "open_file_cache_valid")
+        fileCache.setValid(myAtol(tokens[1], str, fname, lnNbr));
+
+    else if (tokens[0] == "content_cache")
+        contentCache.setBudget(myAtol(tokens[1], str, fname, lnNbr));
+
+    else if (tokens[0] == "content_cache_max_file")
+        contentCache.setMaxFile(myAtol(tokens[1], str, fname, lnNbr));
+
+    else if (tokens[0] == "open_file_cache_errors")
+    {
+        if (tokens[1] == "on")
+            fileCache.setCacheErrors(true);
+        else if (tokens[1] == "off")
+            fileCache.setCacheErrors(false);
+        else
+            throwSyntaxError(str, fname, lnNbr);
+    }
+
+    else
+        throwSyntaxError(str, fname, lnNbr);
+
+    return (0);
+}
+
 short handleDirective(string &str, const string &fName, size_t &lnNbr, WebConfigFile &config)
 {
     static bool srvActive = false;
     static bool inLocation = false;
+    static bool inTypes = false;
+    static bool typesSeen = false;
     static ServerConfig srvTmp;
     static Location locTmp(srvTmp);
 
@@ -304,6 +523,15 @@ short handleDirective(string &str, const string &fName, size_t &lnNbr, WebConfig
         return (0);
     }
 
+    if ((tokens.size() == 1 && tokens[0] == "types{") ||
+        (tokens.size() == 2 && tokens[0] == "types" && tokens[1] == "{"))
+    {
+        if (srvActive || inTypes)
+            throwSyntaxError(str, fName, lnNbr);
+        inTypes = true;
+        return (0);
+    }
+
     if ((tokens.size() == 1 && tokens[0] == "location{") ||
         (tokens.size() == 2 && tokens[0] == "location" && tokens[1] == "{"))
     {
@@ -316,10 +544,23 @@ short handleDirective(string &str, const string &fName, size_t &lnNbr, WebConfig
 
     if (tokens[0] == "}")
     {
-        if (inLocation)
+        if (inTypes)
+            inTypes = false;
+        else if (inLocation)
         {
             if (locTmp.route == "")
                 throwSyntaxError(str, fName, lnNbr);
+            // two locations for the same route, the second would never be reached
+            if (!srvTmp.routes.add(locTmp.route, locTmp.type, srvTmp.locations.size()))
+                throwSyntaxError(str, fName, lnNbr);
+            locTmp.rootFd = fileCache.openRoot(locTmp.root);
+            // a pool runs the cgi_pass script, with whatever else was set in the block
+            if (locTmp.cgi_workers_max)
+            {
+                if (locTmp.cgi.empty())
+                    throwSyntaxError(str, fName, lnNbr);
+                locTmp.workers = &cgiWorkers.get(locTmp);
+            }
             srvTmp.locations.push_back(locTmp);
             inLocation = false;
         }
@@ -339,12 +580,14 @@ short handleDirective(string &str, const string &fName, size_t &lnNbr, WebConfig
         return (0);
     }
 
-    if (inLocation)
+    if (inTypes)
+        return (handleTypes(str, tokens, typesSeen, fName, lnNbr));
+    else if (inLocation)
         return (handleLocation(str, tokens, locTmp, fName, lnNbr));
     else if (srvActive)
         return (handleServer(str, tokens, srvTmp, fName, lnNbr));
     else
-        throwSyntaxError(str, fName, lnNbr);
+        return (handleMain(str, tokens, fName, lnNbr));
 
     return (0);
 }
@@ -370,6 +613,10 @@ WebConfigFile::WebConfigFile(const string &fName)
 
     if (lnNbr == 0)
         throw runtime_error("Error: Configuration file is empty " + fName);
+
+    // after the whole file, a 'types' block may come after the servers
+    for (size_t i = 0; i < _servers.size(); ++i)
+        _servers[i].loadErrorPages();
 }
 
 WebConfigFile::~WebConfigFile()
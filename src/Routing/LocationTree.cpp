@@ -0,0 +1,238 @@
+#include "LocationTree.hpp"
+#include <cstring>
+#include <algorithm>
+
+// length of the segment 's' starts with, its leading '/' included
+static size_t segmentLength(const char* s, size_t len)
+{
+    const void* slash = len > 1 ? std::memchr(s + 1, '/', len - 1) : NULL;
+    return slash ? static_cast<const char*>(slash) - s : len;
+}
+
+static int compareSegments(const char* a, size_t alen, const char* b, size_t blen)
+{
+    int diff = std::memcmp(a, b, std::min(alen, blen));
+    if (diff)
+        return diff;
+    return alen < blen ? -1 : alen > blen;
+}
+
+LocationTree::LocationTree()
+{
+    clear();
+}
+
+void    LocationTree::clear()
+{
+    charNode root;
+
+    _segments.clear();
+    _suffixes.clear();
+    _newSegment("");
+    root.location = -1;
+    _suffixes.push_back(root);
+}
+
+size_t  LocationTree::_newSegment(const std::string& label)
+{
+    segNode n;
+
+    n.label = label;
+    n.prefix = -1;
+    n.exact = -1;
+    _segments.push_back(n);
+    return _segments.size() - 1;
+}
+
+// binary search among the children, 'at' is where it is (or would go)
+bool    LocationTree::_findChild(size_t node, const char* seg, size_t len, size_t& at) const
+{
+    const std::vector<size_t>& children = _segments[node].children;
+    size_t lo = 0;
+    size_t hi = children.size();
+
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        const std::string& label = _segments[children[mid]].label;
+        int diff = compareSegments(label.data(), segmentLength(label.data(), label.size()), seg, len);
+        if (diff == 0)
+        {
+            at = mid;
+            return true;
+        }
+        if (diff < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    at = lo;
+    return false;
+}
+
+// the node standing for 'path', split or created as needed
+size_t  LocationTree::_insertPath(const std::string& path)
+{
+    size_t node = 0;
+    size_t pos = 0;
+
+    while (pos < path.size())
+    {
+        const char* rest = path.data() + pos;
+        size_t      len = path.size() - pos;
+        size_t      at;
+
+        if (!_findChild(node, rest, segmentLength(rest, len), at))
+        {
+            size_t child = _newSegment(std::string(rest, len));
+            _segments[node].children.insert(_segments[node].children.begin() + at, child);
+            return child;
+        }
+
+        // how many whole segments the child's label shares with the rest of the path
+        size_t child = _segments[node].children[at];
+        const std::string& label = _segments[child].label;
+        size_t common = 0;
+        while (common < label.size())
+        {
+            size_t end = common + segmentLength(label.data() + common, label.size() - common);
+            if (end > len || std::memcmp(label.data() + common, rest + common, end - common) != 0
+                || (end < len && rest[end] != '/'))
+                break;
+            common = end;
+        }
+
+        if (common < label.size())
+        {
+            // the child keeps the tail of its label under a new node for the shared head
+            size_t mid = _newSegment(label.substr(0, common));
+            _segments[child].label.erase(0, common);
+            _segments[mid].children.push_back(child);
+            _segments[node].children[at] = mid;
+            child = mid;
+        }
+        node = child;
+        pos += common;
+    }
+    return node;
+}
+
+bool    LocationTree::add(const std::string& route, routeType type, int location)
+{
+    if (type == ROUTE_SUFFIX)
+    {
+        size_t node = 0;
+        for (size_t i = route.size(); i-- > 0; )
+        {
+            std::vector<std::pair<char, size_t> >& children = _suffixes[node].children;
+            std::pair<char, size_t> key(route[i], 0);
+            std::vector<std::pair<char, size_t> >::iterator it =
+                std::lower_bound(children.begin(), children.end(), key);
+            if (it != children.end() && it->first == route[i])
+            {
+                node = it->second;
+                continue;
+            }
+            charNode n;
+            n.location = -1;
+            children.insert(it, std::make_pair(route[i], _suffixes.size()));
+            _suffixes.push_back(n);
+            node = _suffixes.size() - 1;
+        }
+        if (_suffixes[node].location != -1)
+            return false;
+        _suffixes[node].location = location;
+        return true;
+    }
+
+    // "/" is the root itself, the others are keyed without their trailing '/'
+    // unless the route is exact, "= /docs/" doesn't match "/docs"
+    std::string path = route;
+    if (type == ROUTE_PREFIX)
+        while (!path.empty() && path[path.size() - 1] == '/')
+            path.erase(path.size() - 1);
+    else if (path == "/")
+        path.clear();
+
+    segNode& n = _segments[_insertPath(path)];
+    int& slot = type == ROUTE_EXACT ? n.exact : n.prefix;
+    if (slot != -1)
+        return false;
+    slot = location;
+    return true;
+}
+
+int     LocationTree::_findSuffix(const std::string& path) const
+{
+    int     found = -1;
+    size_t  node = 0;
+
+    for (size_t i = path.size(); i-- > 0; )
+    {
+        const std::vector<std::pair<char, size_t> >& children = _suffixes[node].children;
+        std::vector<std::pair<char, size_t> >::const_iterator it =
+            std::lower_bound(children.begin(), children.end(), std::make_pair(path[i], size_t(0)));
+        if (it == children.end() || it->first != path[i])
+            break;
+        node = it->second;
+        if (_suffixes[node].location != -1)
+            found = _suffixes[node].location;
+    }
+    return found;
+}
+
+int     LocationTree::find(const std::string& path) const
+{
+    const char* rest = path.data();
+    size_t      len = path.size() == 1 && path[0] == '/' ? 0 : path.size();
+    size_t      node = 0;
+    int         prefix = _segments[0].prefix;
+    int         exact = -1;
+
+    while (true)
+    {
+        if (len == 0)
+        {
+            exact = _segments[node].exact;
+            break;
+        }
+
+        size_t at;
+        if (!_findChild(node, rest, segmentLength(rest, len), at))
+            break;
+
+        const std::string& label = _segments[_segments[node].children[at]].label;
+        if (label.size() > len || std::memcmp(label.data(), rest, label.size()) != 0
+            || (label.size() < len && rest[label.size()] != '/'))
+            break;
+
+        node = _segments[node].children[at];
+        rest += label.size();
+        len -= label.size();
+        if (_segments[node].prefix != -1)
+            prefix = _segments[node].prefix;
+    }
+
+    if (exact != -1)
+        return exact;
+    int suffix = _findSuffix(path);
+    return suffix != -1 ? suffix : prefix;
+}
+
+bool    LocationTree::parseSuffix(const std::string& pattern, std::string& suffix)
+{
+    suffix.clear();
+    if (pattern.size() < 2 || pattern[pattern.size() - 1] != '$')
+        return false;
+
+    for (size_t i = 0; i + 1 < pattern.size(); ++i)
+    {
+        char c = pattern[i];
+        if (c == '\\' && i + 2 < pattern.size())
+            c = pattern[++i];
+        else if (std::strchr("\\.^$*+?()[]{}|", c))
+            return false;
+        suffix += c;
+    }
+    return !suffix.empty();
+}
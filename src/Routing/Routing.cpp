@@ -7,7 +7,10 @@ RouteMatch::RouteMatch()
       isCGI(false),
       isRedirect(false),
       isDirectory(false),
+      isFile(false),
+      doesExist(false),
       autoIndex(false),
+      gzipStatic(false),
       maxBodySize(0)
 {
 }
@@ -22,10 +25,15 @@ bool RouteMatch::isUploadAllowed() const
     return (!uploadDir.empty());
 }
 
-Routing::Routing(ServerConfig &server) : _server(server)
+Routing::Routing(ServerConfig &server) : _server(&server)
 {
 }
 
+void Routing::setServer(ServerConfig &server)
+{
+    _server = &server;
+}
+
 RouteMatch Routing::match(const string &path, const string &method)
 {
     RouteMatch result;
@@ -41,16 +49,19 @@ RouteMatch Routing::match(const string &path, const string &method)
     if (!result.methodAllowed)
         return (result);
 
+    // the parser already normalized the path, no need to clean it again
     result.fsPath = _resolvePath(*loc, path);
-    result.normURI = _cleanPath(path);
+    result.normURI = path;
 
     result.isCGI = _isCGI(*loc);
     result.isRedirect = !loc->redirect.empty();
-    result.isDirectory = _isDirectory(result.fsPath);
-    result.isFile = _isFile(result.fsPath);
-    result.doesExist = _isPathExists(result.fsPath);
+    result.file = lookup(*loc, result.fsPath);
+    result.isDirectory = result.file->isDirectory();
+    result.isFile = result.file->isFile();
+    result.doesExist = result.file->exists();
 
     result.autoIndex = loc->autoindex;
+    result.gzipStatic = loc->gzip_static;
     result.uploadDir = loc->upload;
     result.redirectUrl = loc->redirect;
     result.maxBodySize = _getMaxBodySize(*loc);
@@ -58,20 +69,23 @@ RouteMatch Routing::match(const string &path, const string &method)
 
     if (result.isCGI)
     {
-        result.scriptPath = loc->cgi;
+        // a FastCGI application gets the requested file as its script
+        result.scriptPath = loc->cgi.empty() ? result.fsPath : loc->cgi;
         result.pathInfo = "";
         result.scriptInterpreter = loc->scriptInterpreter;
+        result.fastcgiPass = loc->fastcgi;
     }
 
     return (result);
 }
 
-string Routing::getErrorPage(int code)
+contentPtr Routing::getErrorPage(int code)
 {
-    if (_server.errors.find(code) != _server.errors.end())
-        return (_server.errors[code]);
+    map<int, contentPtr>::const_iterator it = _server->errorPages.find(code);
+    if (it != _server->errorPages.end())
+        return (it->second);
 
-    return ("");
+    return (getErrorResponse(code));
 }
 
 string Routing::getAllowedMethodsStr(Location &loc)
@@ -92,67 +106,26 @@ string Routing::getAllowedMethodsStr(Location &loc)
 
 Location *Routing::_findLocation(const string &path)
 {
-    Location *bestMatch = NULL;
-    size_t bestLen = 0;
-
-    for (size_t i = 0; i < _server.locations.size(); ++i)
-    {
-        Location &loc = _server.locations[i];
-        if (_matchesRoute(path, loc.route) && loc.route.length() > bestLen)
-        {
-            bestMatch = &loc;
-            bestLen = loc.route.length();
-        }
-    }
-    return (bestMatch);
+    int i = _server->routes.find(path);
+    return (i < 0 ? NULL : &_server->locations[i]);
 }
 
-bool Routing::_matchesRoute(const string &path, const string &route)
+// paths built from a location's root are opened beneath it
+filePtr Routing::lookup(Location &loc, const string &fsPath)
 {
-    if (route == "/")
-        return (true);
-
-    if (path.compare(0, route.size(), route) == 0)
-    {
-        if (path.size() == route.size() || path[route.size()] == '/')
-            return (true);
-    }
-
-    return (false);
+    return (fileCache.get(fsPath, loc.rootFd, _getRoot(loc).size()));
 }
 
-string Routing::_resolvePath(Location &loc, const string &reqPath)
+string Routing::resolvePath(Location &loc, const string &uri)
 {
-    std::string root = _getRoot(loc);
-    std::string relative = _getRelativePath(reqPath, loc.route);
-    std::string full = _joinPath(root, relative);
-    return (_cleanPath(full));
+    return (_resolvePath(loc, uri));
 }
 
-string Routing::_cleanPath(const string &path)
+string Routing::_resolvePath(Location &loc, const string &reqPath)
 {
-    std::vector<std::string> parts;
-    std::stringstream ss(path);
-    std::string item;
-
-    while (std::getline(ss, item, '/'))
-    {
-        if (item == "")
-            continue;
-        if (item == ".." && !parts.empty())
-            parts.pop_back();
-        else if (item != "..")
-            parts.push_back(item);
-    }
-
-    std::string normalized = "";
-    for (size_t i = 0; i < parts.size(); ++i)
-    {
-        normalized += parts[i];
-        if (i < parts.size() - 1)
-            normalized += "/";
-    }
-    return (normalized);
+    std::string root = _getRoot(loc);
+    std::string relative = _getRelativePath(reqPath, loc);
+    return (_joinPath(root, relative));
 }
 
 string Routing::_joinPath(const string &base, const string &path)
@@ -169,31 +142,29 @@ string Routing::_joinPath(const string &base, const string &path)
     return (base + (path[0] == '/' ? path : "/" + path));
 }
 
-string Routing::_getRelativePath(const string &path, const string &route)
+// a prefix location maps what follows its route under its root, an exact
+// one maps to the root itself, a suffix one maps the whole path. so do
+// paths outside the route, try_files candidates can be anywhere
+string Routing::_getRelativePath(const string &path, const Location &loc)
 {
-    if (path.compare(0, route.size(), route) == 0)
-        return (path.substr(route.size()));
+    if (loc.type == ROUTE_SUFFIX)
+        return (path);
+    if (loc.type == ROUTE_EXACT)
+        return (path == loc.route ? "" : path);
+
+    size_t len = loc.route.size();
+    while (len > 1 && loc.route[len - 1] == '/')
+        --len;
+    if (len > 1 && path.compare(0, len, loc.route, 0, len) == 0
+        && (path.size() == len || path[len] == '/'))
+        return (path.substr(len));
 
     return (path);
 }
 
 bool Routing::_isCGI(Location &loc)
 {
-    return (!loc.cgi.empty());
-}
-
-void Routing::_splitCGIPath(const string &fsPath, string &scriptPath, string &pathInfo)
-{
-    std::string tmp = fsPath;
-    while (!tmp.empty() && !_isFile(tmp))
-    {
-        size_t pos = tmp.find_last_of('/');
-        if (pos == std::string::npos)
-            break;
-        tmp = tmp.substr(0, pos);
-    }
-    scriptPath = tmp;
-    pathInfo = fsPath.substr(tmp.length());
+    return (!loc.cgi.empty() || !loc.fastcgi.empty());
 }
 
 bool Routing::_isMethodAllowed(Location &loc, const string &method)
@@ -210,32 +181,14 @@ bool Routing::_isMethodAllowed(Location &loc, const string &method)
     return (false);
 }
 
-bool Routing::_isPathExists(const string &path)
-{
-    struct stat st;
-    return (stat(path.c_str(), &st) == 0);
-}
-
-bool Routing::_isDirectory(const string &path)
-{
-    struct stat st;
-    return (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode));
-}
-
-bool Routing::_isFile(const string &path)
-{
-    struct stat st;
-    return (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode));
-}
-
 string Routing::_getRoot(Location &loc)
 {
-    return (loc.root.empty() ? _server.root : loc.root);
+    return (loc.root.empty() ? _server->root : loc.root);
 }
 
 size_t Routing::_getMaxBodySize(Location &loc)
 {
-    return (loc.maxBody ? loc.maxBody : _server.maxBody);
+    return (loc.maxBody ? loc.maxBody : _server->maxBody);
 }
 
 vector<string> Routing::_getIndexFiles(Location &loc)
@@ -243,5 +196,5 @@ vector<string> Routing::_getIndexFiles(Location &loc)
     if (!loc.indexFiles.empty())
         return (loc.indexFiles);
 
-    return (_server.indexFiles);
+    return (_server->indexFiles);
 }
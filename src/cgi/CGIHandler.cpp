@@ -7,6 +7,7 @@ void CGIHandler::onEvent(uint32_t events)
 	if (IS_ERROR_EVENT(events))
 	{
 		onError();
+		_watchClient();
 		return;
 	}
 	if (IS_READ_EVENT(events))
@@ -21,12 +22,38 @@ void CGIHandler::onEvent(uint32_t events)
 	{
 		onTimeout();
 	}
+	_watchClient();
 }
 
 void CGIHandler::onReadable()
 {
 	Logger logger;
+
+	// through onError(), the output may wait on the client or be closed
+	if (_paused || _outputPipe.read_fd() == -1)
+		return;
 	
+	if (_splice)
+	{
+		int available = 0;
+		if (ioctl(_outputPipe.read_fd(), FIONREAD, &available) == -1)
+		{
+			logger.error("CGI read error");
+			onError();
+			return;
+		}
+		// left in the pipe for the client to splice() out, the fd is back
+		// in the loop once that chunk is sent, see resume()
+		if (available > 0)
+		{
+			_response.feedPipe(_outputPipe.read_fd(), available);
+			_fd_manager.detachFd(_outputPipe.read_fd());
+			_paused = true;
+			return;
+		}
+		// readable and empty, the script is done
+	}
+
 	char buffer[BUFFER_SIZE];
 	ssize_t bytesRead = _outputPipe.read(buffer, BUFFER_SIZE);
 
@@ -42,28 +69,42 @@ void CGIHandler::onReadable()
 		_fd_manager.detachFd(_outputPipe.read_fd());
 		_outputPipe.closeRead();
 
-		if (_cgiParser.getState() < BODY)
-		{
-			logger.error("CGI output incomplete - no body received");
-			status = 502;
-			_isRunning = false;
+		if (!relayEnd())
 			onError();
-			return;
-		}
+		return;
+	}
 
-		_response.feedRAW("");
-		_isRunning = false;
+	if (!relayOutput(buffer, bytesRead))
+	{
+		onError();
 		return;
 	}
+	// the client is behind, the script waits on a full pipe meanwhile
+	if (_response.isFull())
+	{
+		_fd_manager.detachFd(_outputPipe.read_fd());
+		_paused = true;
+	}
+}
+
+bool CGIHandler::relayOutput(const char *data, size_t size)
+{
+	Logger logger;
+
+	// past the headers the output goes out as it comes
+	if (!_ShouldAddSLine)
+	{
+		_response.feedRAW(data, size);
+		return true;
+	}
 
-	_cgiParser.addChunk(buffer, bytesRead);
+	_cgiParser.addChunk(const_cast<char *>(data), size);
 
 	if (_cgiParser.isError())
 	{
 		logger.error("CGI response parsing error");
 		status = 502;
-		onError();
-		return;
+		return false;
 	}
 
 
@@ -81,78 +122,181 @@ void CGIHandler::onReadable()
 		
 		_response.startLine(statusCode);
 		
+		bool encoded = false;
 		strmap& headers = _cgiParser.getHeaders();
 		for (strmap::iterator it = headers.begin(); it != headers.end(); ++it)
 		{
 			std::string key = it->first;
 			std::transform(key.begin(), key.end(), key.begin(), ::tolower);
 			
-			if (key == "status")
+			// the body always goes out chunked, a length would contradict it
+			if (key == "status" || key == "content-length")
 				continue;
+			if (key == "content-encoding")
+				encoded = true;
 			
 			_response.addHeader(it->first, it->second);
 		}
+
+		// compressed on the fly as it's relayed, the script's own length only
+		// tells whether it's worth it
+		std::string& type = _cgiParser.getHeader("content-type");
+		if (!encoded && statusCode >= 200 && statusCode != 204 && statusCode != 304
+			&& isCompressible(*_match.location, type))
+		{
+			std::string& length = _cgiParser.getHeader("content-length");
+			coding_t coding = negotiateCoding(*_match.location, _Reqparser.getHeader("accept-encoding"),
+											  type, length.empty() ? -1 : std::atol(length.c_str()));
+			_response.addHeader("Vary", "Accept-Encoding");
+			_response.compressBody(coding, _match.location->gzip_comp_level);
+		}
 		
 		_response.addHeader("Transfer-Encoding", "chunked");
 		
 		_response.endHeaders();
 		
 		_ShouldAddSLine = false;
+		// the rest of a process' output doesn't need to come through here
+		_splice = !_fcgi && !_response.isCompressing();
 		
 	}
 
 	if (_cgiParser.getState() >= BODY)
 	{
+		char buffer[BUFFER_SIZE];
 		RingBuffer& body = _cgiParser.getBody();
-		size_t bodySize = body.read(buffer, sizeof(buffer));
-		
-		if (bodySize > 0)
-		{
+		size_t bodySize;
+
+		while ((bodySize = body.read(buffer, sizeof(buffer))) > 0)
 			_response.feedRAW(buffer, bodySize);
-		}
 	}
+	return true;
 }
 
-void CGIHandler::onWritable()
+bool CGIHandler::relayEnd()
 {
-	if (!_needBody)
+	_isRunning = false;
+	if (_cgiParser.getState() < BODY)
 	{
-		_fd_manager.detachFd(_inputPipe.write_fd());
-		_inputPipe.closeWrite();
+		Logger logger;
+		logger.error("CGI output incomplete - no body received");
+		status = 502;
+		return false;
+	}
+	_response.feedRAW("");
+	return true;
+}
+
+void CGIHandler::resume()
+{
+	_watchClient();
+	if (!_paused || _response.pipePending() || !_response.isDrained())
+		return;
+	_paused = false;
+	// may finish the request right away
+	if (_fcgi)
+	{
+		_fcgi->resume();
 		return;
 	}
+	if (_outputPipe.read_fd() == -1)
+		return;
+	_expiresAt = time(NULL) + _match.location->cgi_timeout;
+	_fd_manager.add(_outputPipe.read_fd(), this, EPOLLIN);
+}
+
+void CGIHandler::onWritable()
+{
+	if (_inputPipe.write_fd() != -1)
+		_writeBody();
+}
 
-	RingBuffer& body = _Reqparser.getBody();
-	size_t available = body.getSize();
+void CGIHandler::feedBody()
+{
+	RingBuffer &body = _Reqparser.getBody();
 
-	if (available == 0)
+	if (_fcgi)
+		_fcgi->feedStdin(_Reqparser.isComplete());
+	else if (_inputPipe.write_fd() != -1)
 	{
-		_fd_manager.detachFd(_inputPipe.write_fd());
-		_inputPipe.closeWrite();
-		return;
+		_updateExpiresAt(time(NULL) + _match.location->cgi_timeout);
+		_writeBody();
 	}
+	else if (!_queued)	// a queued request keeps it for its worker
+		body.clear();	// the script is done, or never started: nobody reads the rest
+	_watchClient();
+}
 
+// as much of the body as the pipe takes. EPOLLOUT is only watched while
+// the pipe is full, a new piece from the client is written right away
+void CGIHandler::_writeBody()
+{
+	RingBuffer &body = _Reqparser.getBody();
 	char buffer[BUFFER_SIZE];
-	size_t toWrite = (available > BUFFER_SIZE) ? BUFFER_SIZE : available;
-	size_t bytesRead = body.read(buffer, toWrite);
+	size_t size;
 
-	if (bytesRead > 0)
+	while ((size = body.peek(buffer, sizeof(buffer))) > 0)
 	{
-		ssize_t bytesWritten = _inputPipe.write(buffer, bytesRead);
-		if (bytesWritten < 0)
+		ssize_t written = ::write(_inputPipe.write_fd(), buffer, size);
+		if (written < 0 && errno == EAGAIN)
+			break;
+		if (written < 0)
 		{
-			Logger logger;
-			logger.error("CGI write error");
-			onError();
+			// EPIPE, the script exited or closed stdin without reading it all
+			_closeInput();
+			body.clear();
 			return;
 		}
+		body.advanceRead(written);
 	}
-
-	if (body.getSize() == 0)
-	{
+	if (body.getSize() == 0 && _Reqparser.isComplete())
+		_closeInput();
+	else if (body.getSize() == 0)
 		_fd_manager.detachFd(_inputPipe.write_fd());
-		_inputPipe.closeWrite();
-	}
+	else if (!_fd_manager.exists(_inputPipe.write_fd()))
+		_fd_manager.add(_inputPipe.write_fd(), this, EPOLLOUT, false);
+}
+
+// EOF for the script
+void CGIHandler::_closeInput()
+{
+	_fd_manager.detachFd(_inputPipe.write_fd());
+	_inputPipe.closeWrite();
+}
+
+// until the body is complete the client's events are ours. it isn't read
+// while the body ring couldn't take another recv(), the script catches up
+// meanwhile, and it's written to as soon as there's some output: a script
+// may not read more of its stdin before that's gone. once the script stopped
+// reading, the rest waits for the whole request, a client told it's over
+// early could stop sending and reuse the connection with a body left on it
+void CGIHandler::_watchClient()
+{
+	if (_clientFd == -1 || _Reqparser.isComplete() || _Reqparser.isError())
+		return;
+
+	bool input = _inputOpen();
+	RingBuffer &body = _Reqparser.getBody();
+	if (!input || body.getSize() <= body.getCapacity() / 2)
+		_clientPaused = false;
+	else if (body.getSize() + BUFF_SIZE > body.getCapacity())
+		_clientPaused = true;
+
+	uint32_t events = EPOLLERR | EPOLLHUP;
+	if (!_clientPaused)
+		events |= EPOLLIN;
+	if (input && !_response.isComplete())
+		events |= EPOLLOUT;
+	if (events == _clientEvents)
+		return;
+	_fd_manager.modify(_clientFd, events);
+	_clientEvents = events;
+}
+
+// the body still has somewhere to go
+bool CGIHandler::_inputOpen() const
+{
+	return _fcgi || _queued || _inputPipe.write_fd() != -1;
 }
 
 void CGIHandler::onError()
@@ -162,35 +306,30 @@ void CGIHandler::onError()
 	onReadable(); 
 	if (_inputPipe.write_fd() != -1)
 	{
-		_fd_manager.detachFd(_inputPipe.write_fd());
-		_inputPipe.closeWrite();
+		_closeInput();
+		_Reqparser.getBody().clear();
 	}
-	int waitStatus = 0;
-	pid_t result = waitpid(_pid, &waitStatus, WNOHANG);
+	// no waiting here: an exit not reported yet comes through onChildExit(),
+	// a process still there once the request is over is stopped by end()
+	if (_exitStatus != -1 && !(WIFEXITED(_exitStatus) && WEXITSTATUS(_exitStatus) == 0))
+		status = 502;
+}
 
-	if (result == 0)
-	{
-		logger.warning("CGI process still running, sending SIGKILL");
-		::kill(_pid, SIGKILL);
-		waitpid(_pid, &waitStatus, 0);
-	}
-	else if (result > 0)
-	{
-		if (WIFEXITED(waitStatus))
-		{
-			int exitStatus = WEXITSTATUS(waitStatus);
-			if (exitStatus != 0)
-			{
-				status = 502;
-			}
-		}
-		else if (WIFSIGNALED(waitStatus))
-		{
-			int signal = WTERMSIG(waitStatus);
-			logger.error("CGI process terminated by signal: " + intToString(signal));
-			status = 502;
-		}
-	}
+void CGIHandler::onChildExit(ChildProcess *, int waitStatus)
+{
+	Logger logger;
+
+	_process = NULL;
+	_exitStatus = waitStatus;
+	if (WIFEXITED(waitStatus) && WEXITSTATUS(waitStatus) == 0)
+		return;
+	if (WIFSIGNALED(waitStatus))
+		logger.error("CGI process terminated by signal: " + intToString(WTERMSIG(waitStatus)));
+	else
+		logger.warning("CGI process exited with status " + intToString(WEXITSTATUS(waitStatus)));
+	// nothing sent yet, the error page can still be
+	if (_ShouldAddSLine)
+		status = 502;
 }
 
 void CGIHandler::initArgv(RouteMatch const &match)
@@ -208,10 +347,8 @@ void CGIHandler::initArgv(RouteMatch const &match)
 	_argv.push_back(NULL);
 }
 
-void CGIHandler::initEnv(HTTPParser &parser)
+void CGIHandler::buildEnv(HTTPParser &parser, std::vector<std::string> &envStrings)
 {
-	std::vector<std::string> envStrings;
-
 	envStrings.push_back("GATEWAY_INTERFACE=CGI/1.1");
 	envStrings.push_back("SERVER_PROTOCOL=" + parser.getVers());
 	envStrings.push_back("REQUEST_METHOD=" + parser.getMethod());
@@ -246,7 +383,13 @@ void CGIHandler::initEnv(HTTPParser &parser)
 		std::replace(key.begin(), key.end(), '-', '_');
 		envStrings.push_back("HTTP_" + key + "=" + it->second);
 	}
+}
 
+void CGIHandler::initEnv(HTTPParser &parser)
+{
+	std::vector<std::string> envStrings;
+
+	buildEnv(parser, envStrings);
 	_env.clear();
 	for (size_t i = 0; i < envStrings.size(); ++i)
 	{
@@ -257,25 +400,35 @@ void CGIHandler::initEnv(HTTPParser &parser)
 	_env.push_back(NULL); 
 }
 
-CGIHandler::CGIHandler(HTTPParser &parser, HTTPResponse &response, ServerConfig &config, FdManager &fdm)
+CGIHandler::CGIHandler(HTTPParser &parser, HTTPResponse &response, ServerConfig &config, FdManager &fdm, int clientFd)
 : EventHandler(config, fdm, -1),
     _scriptPath(""),
     _inputPipe(),
     _outputPipe(),
     _pid(-1),
+    _process(NULL),
+    _exitStatus(-1),
     status(0),
     _Reqparser(parser),
     _cgiParser(),
     _response(response),
     _isRunning(false),
     _needBody(false),
-	_ShouldAddSLine(true)
+	_ShouldAddSLine(true),
+	_splice(false),
+	_paused(false),
+	_clientFd(clientFd),
+	_clientPaused(false),
+	_clientEvents(READ_EVENT),
+	_fcgi(NULL),
+	_queued(false)
 {
 	_cgiParser.setCGIMode(true); 
 }
 
 CGIHandler::~CGIHandler()
 {
+	_clientFd = -1;
 	end();
 }
 
@@ -288,6 +441,33 @@ void CGIHandler::start(const RouteMatch &match, bool body_availelbe)
 	_needBody = body_availelbe;
 	_scriptPath = match.scriptPath;
 	_match = match;
+	if (!match.fastcgiPass.empty())
+	{
+		if (!startFastCGI(fastcgiPool.get(match.fastcgiPass)))
+		{
+			Logger logger;
+			logger.error("No FastCGI connection to " + match.fastcgiPass);
+			status = 502;
+		}
+		return;
+	}
+	// with every worker busy the request waits for one, a pool that has no
+	// runner to start leaves it to a process of its own
+	if (match.location->workers && match.location->workers->usable())
+	{
+		if (startFastCGI(*match.location->workers))
+			return;
+		_isRunning = true;
+		_queued = match.location->workers->wait(this);
+		if (!_queued)
+		{
+			Logger logger;
+			logger.error("No CGI worker free for " + match.scriptPath);
+			status = 503;
+			_isRunning = false;
+		}
+		return;
+	}
 	try
 	{
 		initArgv(match);
@@ -327,35 +507,27 @@ void CGIHandler::start(const RouteMatch &match, bool body_availelbe)
 			return;
 		}
 	}
-	_pid = fork();
+	_pid = spawnProcess(_argv.data(), _env.data(), _inputPipe.read_fd(), _outputPipe.write_fd());
 	if (_pid < 0)
 	{
-		throw std::runtime_error("Failed to fork process for CGI");
+		logger.error("Failed to start CGI " + std::string(_argv[0]) + ": " + std::strerror(errno));
+		status = 502;
+		end();
+		return;
 	}
-	else if (_pid == 0)
+	_process = ChildProcess::watch(_pid, this, _config, _fd_manager);
+	if (!_process)
 	{
-		if (dup2(_inputPipe.read_fd(), STDIN_FILENO) == -1)
-		{
-			std::perror("dup2 stdin");
-			std::exit(1);
-		}
-
-		if (dup2(_outputPipe.write_fd(), STDOUT_FILENO) == -1)
-		{
-			std::perror("dup2 stdout");
-			std::exit(1);
-		}
-
-		_inputPipe.close();
-		_outputPipe.close();
-
-		execve(_argv[0], _argv.data(), _env.data());
-
-		std::perror("execve");
-		std::exit(1);
+		status = 502;
+		end();
+		return;
 	}
 	else
 	{
+		// the child's ends first: the flag is shared with its copies
+		_inputPipe.closeRead();
+		_outputPipe.closeWrite();
+
         try 
         {
             _inputPipe.set_non_blocking();
@@ -366,21 +538,13 @@ void CGIHandler::start(const RouteMatch &match, bool body_availelbe)
             throw std::runtime_error("Failed to set non-blocking mode for CGI pipes: " + std::string(e.what()));
         }
 
-		_inputPipe.closeRead();
-		_outputPipe.closeWrite();
-
-		RingBuffer body = _Reqparser.getBody();
 		_expiresAt = time(NULL) + match.location->cgi_timeout;
-		if (_needBody && body.getSize() > 0)
-		{
-			_fd_manager.add(_inputPipe.write_fd(), this, EPOLLOUT, false);
-		}
+		_fd_manager.add(_outputPipe.read_fd(), this, EPOLLIN);
+		// what came with the headers, the rest through feedBody()
+		if (_needBody)
+			_writeBody();
 		else
-		{
 			_inputPipe.closeWrite();
-		}
-
-		_fd_manager.add(_outputPipe.read_fd(), this, EPOLLIN);
 
 		_isRunning = true;
 		expires_at = time(NULL) + match.location->cgi_timeout;
@@ -404,6 +568,16 @@ bool CGIHandler::isRunning() const
 
 void CGIHandler::end()
 {
+	if (_queued)
+	{
+		_match.location->workers->cancel(this);
+		_queued = false;
+	}
+	if (_fcgi)
+	{
+		_fcgi->abort();
+		_fcgi = NULL;
+	}
 	_fd_manager.remove(_inputPipe.write_fd());
 	_fd_manager.remove(_outputPipe.read_fd());
 	_inputPipe.close();
@@ -414,17 +588,23 @@ void CGIHandler::end()
 			delete[] _env[i];
 	}
 	_env.clear();
-	if (!_isRunning)
-		return;
-
-	::kill(_pid, SIGKILL);
-
-	int waitStatus;
-	waitpid(_pid, &waitStatus, 0);
-
+	// the rest of the body is read, and dropped
+	_watchClient();
+	// SIGTERM now, SIGKILL from a timer if it doesn't go; reaped by the loop
+	if (_process)
+	{
+		_process->stop();
+		_process = NULL;
+	}
 	_isRunning = false;
 }
 
+void CGIHandler::abort(int code)
+{
+	end();
+	status = code;
+}
+
 void CGIHandler::reset()
 {
 	end();
@@ -446,10 +626,15 @@ void CGIHandler::reset()
 	_scriptPath.clear();
 	_interpreterPath.clear();
 	_pid = -1;
+	_exitStatus = -1;
 	status = 0;
 	_isRunning = false;
 	_needBody = false;
 	_ShouldAddSLine = true;
+	_splice = false;
+	_paused = false;
+	_clientPaused = false;
+	_clientEvents = READ_EVENT;
 
 	_cgiParser.reset();
 }
@@ -467,9 +652,90 @@ void CGIHandler::destroy()
 void CGIHandler::onTimeout()
 {
 	Logger logger;
+	// waiting on the client, not on the script
+	if (_paused)
+	{
+		_updateExpiresAt(time(NULL) + _match.location->cgi_timeout);
+		return;
+	}
 	logger.error("CGIHandler::onTimeout() called - CGI script timed out");
 	end();
 	status = 504;
 	_response.feedRAW("", 0);
 	_isRunning = false;
 }
+
+// fastcgi_pass or cgi_workers: no process of our own, the request goes to
+// an application already running, on a connection kept open from a previous
+// request when there's one. the body follows in FCGI_STDIN records as it comes
+bool CGIHandler::startFastCGI(FastCGIUpstream &upstream)
+{
+	std::vector<std::string> params;
+
+	_fcgi = upstream.acquire(_config, _fd_manager);
+	if (!_fcgi)
+		return false;
+	buildEnv(_Reqparser, params);
+	_isRunning = true;
+	// a failure right away comes back through onFcgiError()
+	_fcgi->begin(this, params, _needBody ? &_Reqparser.getBody() : NULL, _match.location->cgi_timeout);
+	// the body may have come whole with the headers
+	if (_fcgi && _needBody)
+		feedBody();
+	return true;
+}
+
+void CGIHandler::onFcgiOutput(const char *data, size_t size)
+{
+	if (!relayOutput(data, size))
+	{
+		end();
+		return;
+	}
+	if (_response.isFull())
+	{
+		_fcgi->pause();
+		_paused = true;
+	}
+	_watchClient();
+}
+
+void CGIHandler::onFcgiEnd(int appStatus)
+{
+	_fcgi = NULL;
+	_Reqparser.getBody().clear();
+	if (appStatus != 0)
+	{
+		Logger logger;
+		logger.warning("FastCGI request ended with status " + intToString(appStatus));
+	}
+	relayEnd();
+	_watchClient();
+}
+
+void CGIHandler::onFcgiBodySent()
+{
+	_watchClient();
+}
+
+void CGIHandler::onFcgiReady()
+{
+	CGIWorkerPool &pool = *_match.location->workers;
+
+	_queued = false;
+	if (startFastCGI(pool))
+		return;
+	// taken by someone else meanwhile, or it failed to start
+	_queued = pool.wait(this);
+	if (!_queued)
+		onFcgiError(503);
+}
+
+void CGIHandler::onFcgiError(int code)
+{
+	_fcgi = NULL;
+	_Reqparser.getBody().clear();
+	_watchClient();
+	status = code;
+	_isRunning = false;
+}
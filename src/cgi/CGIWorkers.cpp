@@ -0,0 +1,300 @@
+#include "CGIWorkers.hpp"
+#include "Spawn.hpp"
+#include "Logger.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+
+#define BELL_NO_TIMEOUT     (365 * 24 * 3600)
+
+CGIWorkers cgiWorkers;
+
+std::string intToString(int value);
+
+CGIWorkerPool::CGIWorkerPool(const Location& loc):
+    _min(loc.cgi_workers_min),
+    _max(loc.cgi_workers_max),
+    _maxRequests(loc.cgi_worker_requests),
+    _idleTimeout(loc.cgi_worker_idle),
+    _bell(NULL),
+    _failures(0),
+    _retryAt(0)
+{
+    if (!loc.scriptInterpreter.empty())
+        _argv.push_back(loc.scriptInterpreter);
+    _argv.push_back(loc.cgi_worker);
+    _argv.push_back(loc.cgi);
+    _address = "cgi workers of " + loc.cgi;
+
+    const char* path = std::getenv("PATH");
+    _path = std::string("PATH=") + (path ? path : "/usr/local/bin:/usr/bin:/bin");
+}
+
+std::string CGIWorkerPool::key(const Location& loc)
+{
+    return loc.scriptInterpreter + ' ' + loc.cgi_worker + ' ' + loc.cgi;
+}
+
+time_t  CGIWorkerPool::idleTimeout() const { return _idleTimeout; }
+bool    CGIWorkerPool::usable() const { return _max > 0; }
+
+void    CGIWorkerPool::start(FdManager& fdm)
+{
+    Logger logger;
+
+    if (access(_argv[0].c_str(), X_OK) == -1)
+    {
+        // every request falls back to a process of its own
+        logger.error("Can't run CGI worker " + _argv[0] + ": " + std::strerror(errno));
+        _max = 0;
+        return;
+    }
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd == -1)
+        logger.error("Can't create the CGI worker queue: " + std::string(std::strerror(errno)));
+    else
+    {
+        _bell = new CGIWorkerBell(fd, *this, fdm);
+        fdm.add(fd, _bell, READ_EVENT);
+    }
+    _fill(ServerConfig(), fdm);
+    logger.info("Started " + intToString(_workers.size()) + " " + _address);
+}
+
+// the worker's stdin is the socket, its stdout goes nowhere: the script's
+// output is sent back in FCGI_STDOUT records. stderr is the server's
+FastCGIConnection*  CGIWorkerPool::_spawn(const ServerConfig& config, FdManager& fdm)
+{
+    if (!_canSpawn())
+        return NULL;
+
+    std::vector<char*> argv;
+    for (size_t i = 0; i < _argv.size(); ++i)
+        argv.push_back(const_cast<char*>(_argv[i].c_str()));
+    argv.push_back(NULL);
+    char* envp[] = { const_cast<char*>(_path.c_str()), NULL };
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1)
+    {
+        _failed();
+        return NULL;
+    }
+    int devnull = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+    pid_t pid = devnull == -1 ? -1 : spawnProcess(&argv[0], envp, sv[1], devnull);
+    ::close(sv[1]);
+    if (devnull != -1)
+        ::close(devnull);
+    if (pid == -1)
+    {
+        Logger logger;
+        logger.error("Can't start a CGI worker: " + std::string(std::strerror(errno)));
+        ::close(sv[0]);
+        _failed();
+        return NULL;
+    }
+    ChildProcess* process = ChildProcess::watch(pid, this, config, fdm);
+    if (!process)
+    {
+        ::close(sv[0]);
+        _failed();
+        return NULL;
+    }
+    fcntl(sv[0], F_SETFL, O_NONBLOCK);
+
+    FastCGIConnection* conn = new FastCGIConnection(sv[0], true, *this, config, fdm);
+    fdm.add(sv[0], conn, READ_EVENT);
+    worker& w = _workers[conn];
+    w.process = process;
+    w.requests = 0;
+    w.started = time(NULL);
+    return conn;
+}
+
+void    CGIWorkerPool::_fill(const ServerConfig& config, FdManager& fdm)
+{
+    while (_workers.size() < _min)
+    {
+        FastCGIConnection* conn = _spawn(config, fdm);
+        if (!conn)
+            break;
+        _idle.push_back(conn);
+    }
+}
+
+bool    CGIWorkerPool::_canSpawn() const
+{
+    return _workers.size() < _max && time(NULL) >= _retryAt;
+}
+
+// 1, 2, 4... seconds before the next start, the bell retries then
+void    CGIWorkerPool::_failed()
+{
+    size_t delay = 1;
+    for (size_t i = 0; i < _failures && delay < CGI_WORKER_BACKOFF; ++i)
+        delay *= 2;
+    if (delay > CGI_WORKER_BACKOFF)
+        delay = CGI_WORKER_BACKOFF;
+    ++_failures;
+    _retryAt = time(NULL) + delay;
+    if (_bell)
+        _bell->wakeAt(_retryAt);
+}
+
+void    CGIWorkerPool::_ring()
+{
+    if (_bell && !_queue.empty())
+        _bell->ring();
+}
+
+FastCGIConnection*  CGIWorkerPool::acquire(const ServerConfig& config, FdManager& fdm)
+{
+    // the idle ones first, checked like any kept alive connection
+    FastCGIConnection* conn = FastCGIUpstream::acquire(config, fdm);
+    if (!conn)
+        conn = _spawn(config, fdm);
+    // replaces the workers that were recycled or died since
+    if (conn)
+        _fill(config, fdm);
+    return conn;
+}
+
+bool    CGIWorkerPool::release(FastCGIConnection* conn)
+{
+    workers_t::iterator it = _workers.find(conn);
+    if (it == _workers.end())
+        return false;
+    _failures = 0;
+    if (++it->second.requests >= _maxRequests)
+        return false;
+    _idle.push_front(conn);
+    _ring();
+    return true;
+}
+
+bool    CGIWorkerPool::wait(FastCGIClient* client)
+{
+    if (!_bell || _queue.size() >= CGI_WORKER_QUEUE)
+        return false;
+    // nothing running that could free up, and nothing can be started yet
+    if (_workers.empty() && !_canSpawn())
+        return false;
+    _queue.push_back(client);
+    return true;
+}
+
+void    CGIWorkerPool::cancel(FastCGIClient* client)
+{
+    _queue.remove(client);
+}
+
+// a client that still gets nothing queues itself again, at the back: the
+// loop ends once there's no idle worker and none can be started
+void    CGIWorkerPool::dispatch()
+{
+    while (!_queue.empty() && (!_idle.empty() || _canSpawn()))
+    {
+        FastCGIClient* client = _queue.front();
+        _queue.pop_front();
+        client->onFcgiReady();
+    }
+}
+
+// the connection is going away: it timed out, failed, or the worker is
+// being replaced. a script stuck in a request won't notice the socket
+// closing, so the worker is stopped either way
+void    CGIWorkerPool::forget(FastCGIConnection* conn)
+{
+    FastCGIUpstream::forget(conn);
+
+    workers_t::iterator it = _workers.find(conn);
+    if (it == _workers.end())
+        return;
+    if (it->second.process)
+        it->second.process->stop();
+    // the runner or the script can't even start, don't start it right away again
+    if (!it->second.requests && time(NULL) - it->second.started < CGI_WORKER_STARTUP)
+        _failed();
+    _workers.erase(it);
+    _ring();
+}
+
+void    CGIWorkerPool::onChildExit(ChildProcess* child, int status)
+{
+    for (workers_t::iterator it = _workers.begin(); it != _workers.end(); ++it)
+    {
+        if (it->second.process != child)
+            continue;
+        it->second.process = NULL;
+        Logger logger;
+        logger.warning("A CGI worker of " + _argv.back() + " exited with status " + intToString(status));
+        return;
+    }
+}
+
+bool    CGIWorkerPool::keepIdle(FastCGIConnection*)
+{
+    return _workers.size() <= _min;
+}
+
+CGIWorkerBell::CGIWorkerBell(int fd, CGIWorkerPool& pool, FdManager& fdm):
+    EventHandler(ServerConfig(), fdm, time(NULL) + BELL_NO_TIMEOUT),
+    _fd(fd),
+    _pool(pool)
+{}
+
+CGIWorkerBell::~CGIWorkerBell()
+{
+    _pool._bell = NULL;
+    ::close(_fd);
+}
+
+void    CGIWorkerBell::ring()
+{
+    uint64_t one = 1;
+    if (::write(_fd, &one, sizeof(one)) == -1)
+        return;     // the counter is already set
+}
+
+void    CGIWorkerBell::wakeAt(time_t when)
+{
+    _updateExpiresAt(when);
+}
+
+int     CGIWorkerBell::get_fd() { return _fd; }
+void    CGIWorkerBell::destroy() { delete this; }
+
+void    CGIWorkerBell::onEvent(uint32_t events)
+{
+    uint64_t count;
+
+    if (IS_READ_EVENT(events) && ::read(_fd, &count, sizeof(count)) == -1)
+        return;
+    if (IS_TIMEOUT_EVENT(events))
+        _updateExpiresAt(time(NULL) + BELL_NO_TIMEOUT);
+    _pool.dispatch();
+}
+
+CGIWorkers::~CGIWorkers()
+{
+    for (std::map<std::string, CGIWorkerPool*>::iterator it = _pools.begin(); it != _pools.end(); ++it)
+        delete it->second;
+}
+
+CGIWorkerPool&  CGIWorkers::get(const Location& loc)
+{
+    CGIWorkerPool*& pool = _pools[CGIWorkerPool::key(loc)];
+    if (!pool)
+        pool = new CGIWorkerPool(loc);
+    return *pool;
+}
+
+void    CGIWorkers::start(FdManager& fdm)
+{
+    for (std::map<std::string, CGIWorkerPool*>::iterator it = _pools.begin(); it != _pools.end(); ++it)
+        it->second->start(fdm);
+}
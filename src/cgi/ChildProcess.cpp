@@ -0,0 +1,133 @@
+#include "ChildProcess.hpp"
+#include "Logger.hpp"
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+
+#define CHILD_NO_TIMEOUT    (365 * 24 * 3600)
+
+std::string intToString(int value);
+
+ChildProcess::ChildProcess(pid_t pid, int fd, bool polling, ChildWatcher* watcher,
+                           const ServerConfig& config, FdManager& fdm):
+    EventHandler(config, fdm, time(NULL) + (polling ? 1 : CHILD_NO_TIMEOUT)),
+    _pid(pid),
+    _fd(fd),
+    _polling(polling),
+    _killAt(0),
+    _killed(false),
+    _watcher(watcher)
+{}
+
+// only after _reap(), or at shutdown
+ChildProcess::~ChildProcess()
+{
+    int status = 0;
+
+    if (_pid > 0)
+    {
+        ::kill(-_pid, SIGKILL);
+        waitpid(_pid, &status, 0);
+    }
+    ::close(_fd);
+    if (_watcher)
+        _watcher->onChildExit(this, status);
+}
+
+ChildProcess*   ChildProcess::watch(pid_t pid, ChildWatcher* watcher,
+                                    const ServerConfig& config, FdManager& fdm)
+{
+    bool    polling = false;
+    // always close-on-exec
+    int     fd = syscall(SYS_pidfd_open, pid, 0);
+
+    if (fd == -1)
+    {
+        // never readable, the timeout does the work
+        polling = true;
+        fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    }
+    if (fd == -1)
+    {
+        Logger logger;
+        logger.error("Can't watch process " + intToString(pid) + ", killing it");
+        ::kill(-pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return NULL;
+    }
+    ChildProcess* child = new ChildProcess(pid, fd, polling, watcher, config, fdm);
+    fdm.add(fd, child, READ_EVENT);
+    return child;
+}
+
+int     ChildProcess::get_fd() { return _fd; }
+void    ChildProcess::destroy() { delete this; }
+pid_t   ChildProcess::pid() const { return _pid; }
+
+void    ChildProcess::detach()
+{
+    _watcher = NULL;
+}
+
+void    ChildProcess::stop()
+{
+    _watcher = NULL;
+    if (_killAt)
+        return;
+    _killAt = time(NULL) + CHILD_KILL_DELAY;
+    ::kill(-_pid, SIGTERM);
+    if (!_polling)
+        _updateExpiresAt(_killAt);
+}
+
+// false while the process runs. once it's reaped the watcher hears about
+// it, then the pidfd is removed and 'this' deleted
+bool    ChildProcess::_reap()
+{
+    int     status = 0;
+    pid_t   ret = waitpid(_pid, &status, WNOHANG);
+
+    if (ret == 0 || (ret == -1 && errno == EINTR))
+        return false;
+    _pid = -1;
+
+    ChildWatcher* watcher = _watcher;
+    _watcher = NULL;
+    if (watcher)
+        watcher->onChildExit(this, status);
+    _fd_manager.remove(_fd);
+    return true;
+}
+
+void    ChildProcess::onEvent(uint32_t events)
+{
+    if (IS_TIMEOUT_EVENT(events))
+        onTimeout();
+    else
+        _reap();
+}
+
+void    ChildProcess::onTimeout()
+{
+    if (_reap())
+        return;
+
+    time_t now = time(NULL);
+    if (_killAt && !_killed && now >= _killAt)
+    {
+        Logger logger;
+        logger.warning("Process " + intToString(_pid) + " ignored SIGTERM, sending SIGKILL");
+        ::kill(-_pid, SIGKILL);
+        _killed = true;
+    }
+    if (_polling)
+        _updateExpiresAt(now + 1);
+    else if (_killAt && !_killed)
+        _updateExpiresAt(_killAt);
+    else
+        _updateExpiresAt(now + CHILD_NO_TIMEOUT);
+}
@@ -0,0 +1,544 @@
+#include "FastCGI.hpp"
+#include "Logger.hpp"
+#include <cerrno>
+#include <cctype>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/un.h>
+
+FastCGIPool fastcgiPool;
+
+// name and value lengths take one byte below 128, four with the high bit set otherwise
+static void putLength(std::string& out, size_t len)
+{
+    if (len < 128)
+    {
+        out += static_cast<char>(len);
+        return;
+    }
+    out += static_cast<char>((len >> 24) | 0x80);
+    out += static_cast<char>(len >> 16);
+    out += static_cast<char>(len >> 8);
+    out += static_cast<char>(len);
+}
+
+FastCGIConnection::FastCGIConnection(int fd, bool connected, FastCGIUpstream& upstream,
+                                     const ServerConfig& config, FdManager& fdm):
+    EventHandler(config, fdm, time(NULL) + upstream.idleTimeout()),
+    _fd(fd),
+    _upstream(upstream),
+    _client(NULL),
+    _connected(connected),
+    _timeout(upstream.idleTimeout()),
+    _outSent(0),
+    _stdin(NULL),
+    _stdinLast(false),
+    _stdoutLeft(0),
+    _skipLeft(0),
+    _dispatching(false),
+    _paused(false),
+    _closing(false)
+{}
+
+FastCGIConnection::~FastCGIConnection()
+{
+    _upstream.forget(this);
+    ::close(_fd);
+    if (_client)
+        _client->onFcgiError(502);
+}
+
+int     FastCGIConnection::get_fd() { return _fd; }
+void    FastCGIConnection::destroy() { delete this; }
+bool    FastCGIConnection::isIdle() const { return _client == NULL; }
+
+// one request at a time, so its id is always 1
+void    FastCGIConnection::_record(int type, const char* data, size_t size)
+{
+    do
+    {
+        size_t  len = size < FCGI_MAX_CONTENT ? size : FCGI_MAX_CONTENT;
+        size_t  padding = (8 - len % 8) % 8;
+        char    header[FCGI_HEADER_LEN] = {
+            FCGI_VERSION_1, static_cast<char>(type), 0, 1,
+            static_cast<char>(len >> 8), static_cast<char>(len & 0xff), static_cast<char>(padding), 0
+        };
+
+        _out.append(header, sizeof(header));
+        _out.append(data, len);
+        _out.append(padding, '\0');
+        data += len;
+        size -= len;
+    } while (size > 0);
+}
+
+void    FastCGIConnection::_params(const std::vector<std::string>& params)
+{
+    std::string pairs;
+
+    for (size_t i = 0; i < params.size(); ++i)
+    {
+        size_t eq = params[i].find('=');
+        if (eq == std::string::npos)
+            continue;
+        putLength(pairs, eq);
+        putLength(pairs, params[i].size() - eq - 1);
+        pairs.append(params[i], 0, eq);
+        pairs.append(params[i], eq + 1, std::string::npos);
+    }
+    _record(FCGI_PARAMS, pairs.data(), pairs.size());
+    _record(FCGI_PARAMS, NULL, 0);
+}
+
+void    FastCGIConnection::begin(FastCGIClient* client, const std::vector<std::string>& params,
+                                 RingBuffer* body, time_t timeout)
+{
+    static const char beginBody[8] = { 0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0 };
+
+    _client = client;
+    _timeout = timeout;
+    _updateExpiresAt(time(NULL) + _timeout);
+
+    _record(FCGI_BEGIN_REQUEST, beginBody, sizeof(beginBody));
+    _params(params);
+    _stdin = body;
+    _stdinLast = false;
+    if (!body)
+        _record(FCGI_STDIN, NULL, 0);
+
+    // may fail the request, and delete the connection with it
+    _flush();
+}
+
+void    FastCGIConnection::feedStdin(bool last)
+{
+    if (!_stdin)
+        return;
+    _stdinLast = last;
+    // a slow upload isn't a slow application
+    _updateExpiresAt(time(NULL) + _timeout);
+    _flush();
+}
+
+// the body is queued as it's sent, no more than FASTCGI_STDIN_QUEUE at
+// once: the rest waits in its ring, and the client with it
+void    FastCGIConnection::_fillStdin()
+{
+    char    buff[FASTCGI_STDIN_QUEUE];
+    bool    taken = false;
+
+    if (!_stdin)
+        return;
+    while (_out.size() - _outSent < FASTCGI_STDIN_QUEUE && _stdin->getSize() > 0)
+    {
+        size_t n = _stdin->read(buff, sizeof(buff));
+        _record(FCGI_STDIN, buff, n);
+        taken = true;
+    }
+    if (_stdinLast && _stdin->getSize() == 0)
+    {
+        _record(FCGI_STDIN, NULL, 0);
+        _stdin = NULL;
+    }
+    if (taken && _client)
+        _client->onFcgiBodySent();
+}
+
+bool    FastCGIConnection::_flush()
+{
+    if (!_connected)
+        return true;    // waiting on EPOLLOUT for the connect() to finish
+
+    for (;;)
+    {
+        if (_outSent == _out.size())
+        {
+            _out.clear();
+            _outSent = 0;
+        }
+        _fillStdin();
+        if (_out.empty())
+            break;
+        ssize_t sent = ::send(_fd, _out.data() + _outSent, _out.size() - _outSent, MSG_NOSIGNAL);
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (sent <= 0)
+        {
+            _fail(502);
+            return false;
+        }
+        _outSent += sent;
+    }
+    _watch();
+    return true;
+}
+
+void    FastCGIConnection::_watch()
+{
+    uint32_t events = EPOLLERR | EPOLLHUP;
+
+    if (!_paused)
+        events |= EPOLLIN;
+    if (_outSent != _out.size())
+        events |= EPOLLOUT;
+    _fd_manager.modify(_fd, events);
+}
+
+void    FastCGIConnection::pause()
+{
+    _paused = true;
+    _watch();
+}
+
+// what was read before the pause is handed over first
+void    FastCGIConnection::resume()
+{
+    if (!_paused)
+        return;
+    _paused = false;
+    _updateExpiresAt(time(NULL) + _timeout);
+    _watch();
+    _parse();
+}
+
+// stdout is handed over as it arrives, a record doesn't have to be complete.
+// the others are small (stderr, end of request) and wait to be whole
+void    FastCGIConnection::_parse()
+{
+    size_t pos = 0;
+
+    while (pos < _in.size())
+    {
+        size_t avail = _in.size() - pos;
+
+        if (_stdoutLeft)
+        {
+            size_t n = avail < _stdoutLeft ? avail : _stdoutLeft;
+            _stdoutLeft -= n;
+            // the client may give up on the request from in there
+            _dispatching = true;
+            _client->onFcgiOutput(_in.data() + pos, n);
+            _dispatching = false;
+            pos += n;
+            if (_closing)
+            {
+                _fd_manager.remove(_fd);
+                return;
+            }
+            if (_paused)
+                break;
+            continue;
+        }
+        if (_skipLeft)
+        {
+            size_t n = avail < _skipLeft ? avail : _skipLeft;
+            _skipLeft -= n;
+            pos += n;
+            continue;
+        }
+        if (avail < FCGI_HEADER_LEN)
+            break;
+
+        const unsigned char* h = reinterpret_cast<const unsigned char*>(_in.data() + pos);
+        int     type = h[1];
+        int     id = (h[2] << 8) | h[3];
+        size_t  len = (h[4] << 8) | h[5];
+        size_t  padding = h[6];
+        bool    ours = id == 1 && _client;
+
+        if (!ours || type == FCGI_STDOUT || (type != FCGI_STDERR && type != FCGI_END_REQUEST))
+        {
+            _stdoutLeft = ours && type == FCGI_STDOUT ? len : 0;
+            _skipLeft = padding + (_stdoutLeft ? 0 : len);
+            pos += FCGI_HEADER_LEN;
+            continue;
+        }
+        if (avail < FCGI_HEADER_LEN + len + padding)
+            break;
+
+        const char* content = _in.data() + pos + FCGI_HEADER_LEN;
+        pos += FCGI_HEADER_LEN + len + padding;
+        if (type == FCGI_STDERR && len)
+        {
+            Logger logger;
+            logger.warning("FastCGI stderr: " + std::string(content, len));
+        }
+        else if (type == FCGI_END_REQUEST && len >= 8)
+        {
+            const unsigned char* b = reinterpret_cast<const unsigned char*>(content);
+            int appStatus = (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+            _in.erase(0, pos);
+            _finish(b[4] == FCGI_REQUEST_COMPLETE ? appStatus : -1);
+            return;
+        }
+    }
+    _in.erase(0, pos);
+}
+
+// the connection goes back to the pool before the client hears about it,
+// 'this' may be gone by the time the client is called
+void    FastCGIConnection::_finish(int appStatus)
+{
+    FastCGIClient* client = _client;
+
+    _client = NULL;
+    _updateExpiresAt(time(NULL) + _upstream.idleTimeout());
+    // answered before the whole body was sent, the rest would be taken
+    // for the next request's
+    bool unsent = _stdin != NULL;
+    _stdin = NULL;
+    if (unsent || !_in.empty() || _outSent != _out.size() || !_upstream.release(this))
+        _fd_manager.remove(_fd);
+    client->onFcgiEnd(appStatus);
+}
+
+void    FastCGIConnection::_fail(int status)
+{
+    FastCGIClient* client = _client;
+
+    _client = NULL;
+    _stdin = NULL;
+    _fd_manager.remove(_fd);
+    if (client)
+        client->onFcgiError(status);
+}
+
+void    FastCGIConnection::abort()
+{
+    _client = NULL;
+    _stdin = NULL;
+    if (_dispatching)
+        _closing = true;
+    else
+        _fd_manager.remove(_fd);
+}
+
+void    FastCGIConnection::onEvent(uint32_t events)
+{
+    if (_client)
+        _updateExpiresAt(time(NULL) + _timeout);
+    if (IS_ERROR_EVENT(events) && !IS_READ_EVENT(events))
+    {
+        onError();
+        return;
+    }
+    if (IS_WRITE_EVENT(events) && !_writable())
+        return;
+    if (IS_READ_EVENT(events))
+        onReadable();
+    else if (IS_TIMEOUT_EVENT(events))
+        onTimeout();
+}
+
+void    FastCGIConnection::onWritable()
+{
+    _writable();
+}
+
+bool    FastCGIConnection::_writable()
+{
+    if (!_connected)
+    {
+        int         err = 0;
+        socklen_t   len = sizeof(err);
+        if (getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 || err)
+        {
+            Logger logger;
+            logger.error("Can't connect to FastCGI upstream " + _upstream.address() + ": " + std::strerror(err));
+            _fail(502);
+            return false;
+        }
+        _connected = true;
+    }
+    return _flush();
+}
+
+void    FastCGIConnection::onReadable()
+{
+    // no more per event than a CGI pipe read, so the response buffer never
+    // takes more than that past its high-water mark
+    char    buff[FASTCGI_READ_SIZE];
+    ssize_t n = ::recv(_fd, buff, sizeof(buff), 0);
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return;
+    if (n <= 0)
+    {
+        // an idle connection closed by the application is just dropped
+        if (_client)
+        {
+            Logger logger;
+            logger.error("FastCGI upstream closed the connection: " + _upstream.address());
+        }
+        _fail(502);
+        return;
+    }
+    _in.append(buff, n);
+    _parse();
+}
+
+void    FastCGIConnection::onError()
+{
+    _fail(502);
+}
+
+void    FastCGIConnection::onTimeout()
+{
+    // waiting on the client, not on the application
+    if (_client && _paused)
+    {
+        _updateExpiresAt(time(NULL) + _timeout);
+        return;
+    }
+    if (!_client && _upstream.keepIdle(this))
+    {
+        _updateExpiresAt(time(NULL) + _upstream.idleTimeout());
+        return;
+    }
+    if (_client)
+    {
+        Logger logger;
+        logger.error("FastCGI request timed out: " + _upstream.address());
+    }
+    _fail(504);
+}
+
+FastCGIUpstream::FastCGIUpstream():
+    _addrLen(0)
+{
+    std::memset(&_addr, 0, sizeof(_addr));
+}
+
+FastCGIUpstream::FastCGIUpstream(const std::string& address):
+    _addrLen(0),
+    _address(address)
+{
+    std::memset(&_addr, 0, sizeof(_addr));
+
+    if (address.compare(0, 5, "unix:") == 0)
+    {
+        struct sockaddr_un* un = reinterpret_cast<struct sockaddr_un*>(&_addr);
+        std::string         path = address.substr(5);
+
+        if (path.empty() || path.size() >= sizeof(un->sun_path))
+            throw std::runtime_error("bad FastCGI socket path " + address);
+        un->sun_family = AF_UNIX;
+        std::memcpy(un->sun_path, path.c_str(), path.size() + 1);
+        _addrLen = sizeof(*un);
+        return;
+    }
+
+    // "host:port" or "[v6]:port", resolved once, while the config is read
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos)
+        throw std::runtime_error("no port in FastCGI upstream " + address);
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+    if (host.size() > 2 && host[0] == '[' && host[host.size() - 1] == ']')
+        host = host.substr(1, host.size() - 2);
+
+    struct addrinfo hints;
+    struct addrinfo* res = NULL;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV;
+    int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+    if (err != 0 || !res)
+        throw std::runtime_error("can't resolve FastCGI upstream " + address + ": " + gai_strerror(err));
+    std::memcpy(&_addr, res->ai_addr, res->ai_addrlen);
+    _addrLen = res->ai_addrlen;
+    freeaddrinfo(res);
+}
+
+const std::string&  FastCGIUpstream::address() const { return _address; }
+
+FastCGIConnection*  FastCGIUpstream::acquire(const ServerConfig& config, FdManager& fdm)
+{
+    while (!_idle.empty())
+    {
+        FastCGIConnection* conn = _idle.front();
+        _idle.pop_front();
+
+        // the application may have closed it since, and epoll didn't tell us yet
+        char c;
+        ssize_t n = ::recv(conn->get_fd(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return conn;
+        fdm.remove(conn->get_fd());
+    }
+
+    if (!_addrLen)
+        return NULL;
+    int fd = ::socket(_addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return NULL;
+    int ret = ::connect(fd, reinterpret_cast<struct sockaddr*>(&_addr), _addrLen);
+    if (ret == -1 && errno != EINPROGRESS)
+    {
+        Logger logger;
+        logger.error("Can't connect to FastCGI upstream " + _address + ": " + std::strerror(errno));
+        ::close(fd);
+        return NULL;
+    }
+
+    FastCGIConnection* conn = new FastCGIConnection(fd, ret == 0, *this, config, fdm);
+    fdm.add(fd, conn, ret == 0 ? READ_EVENT : WRITE_EVENT);
+    return conn;
+}
+
+bool    FastCGIUpstream::release(FastCGIConnection* conn)
+{
+    if (_idle.size() >= FASTCGI_KEEPALIVE)
+        return false;
+    _idle.push_front(conn);
+    return true;
+}
+
+void    FastCGIUpstream::forget(FastCGIConnection* conn)
+{
+    _idle.remove(conn);
+}
+
+bool    FastCGIUpstream::keepIdle(FastCGIConnection*)
+{
+    return false;
+}
+
+time_t  FastCGIUpstream::idleTimeout() const
+{
+    return FASTCGI_IDLE_TIMEOUT;
+}
+
+bool    FastCGIUpstream::isValidAddress(const std::string& address)
+{
+    if (address.compare(0, 5, "unix:") == 0)
+        return address.size() > 5;
+
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == address.size())
+        return false;
+    for (size_t i = colon + 1; i < address.size(); ++i)
+    {
+        if (!std::isdigit(static_cast<unsigned char>(address[i])))
+            return false;
+    }
+    long port = std::atol(address.c_str() + colon + 1);
+    return port > 0 && port < 65536;
+}
+
+FastCGIPool::~FastCGIPool()
+{
+    for (std::map<std::string, FastCGIUpstream*>::iterator it = _upstreams.begin(); it != _upstreams.end(); ++it)
+        delete it->second;
+}
+
+FastCGIUpstream&    FastCGIPool::get(const std::string& address)
+{
+    std::map<std::string, FastCGIUpstream*>::iterator it = _upstreams.find(address);
+    if (it == _upstreams.end())
+        it = _upstreams.insert(std::make_pair(address, new FastCGIUpstream(address))).first;
+    return *it->second;
+}
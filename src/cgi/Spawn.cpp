@@ -0,0 +1,41 @@
+#include "Spawn.hpp"
+#include <cerrno>
+#include <csignal>
+#include <spawn.h>
+#include <unistd.h>
+
+pid_t   spawnProcess(char* const argv[], char* const envp[], int in, int out)
+{
+    posix_spawn_file_actions_t  actions;
+    posix_spawnattr_t           attr;
+    sigset_t                    mask;
+    sigset_t                    defaults;
+    pid_t                       pid;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, in, STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+    // our fds are O_CLOEXEC, this covers the streams that can't ask for it
+    posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+
+    sigemptyset(&mask);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    // a group of its own, whatever it starts is signaled along with it
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETPGROUP);
+
+    int err = posix_spawn(&pid, argv[0], &actions, &attr, argv, envp);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err)
+    {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
@@ -1,4 +1,5 @@
 #include "SpecialResponse.hpp"
+#include <sstream>
 
 #define CRLF "\r\n"
 #define WEBSERV_VER "WebServ 1.0"
@@ -233,3 +234,28 @@ const std::string getErrorPage(int code)
     const std::string &page = (it != defaultErrorPages.end()) ? it->second : emptyPage;
     return page + webserv_error_full_tail;
 }
+
+contentPtr renderErrorPage(const std::string &page, const std::string &type)
+{
+    std::ostringstream head;
+    head << "Content-type: " << type << CRLF
+         << "Content-Length: " << page.size() << CRLF
+         << CRLF;
+
+    contentPtr content(new CachedContent);
+    content->type = type;
+    content->data.reserve(head.str().size() + page.size());
+    content->data = head.str();
+    content->data += page;
+    return content;
+}
+
+contentPtr getErrorResponse(int code)
+{
+    static std::map<int, contentPtr> rendered;
+
+    contentPtr &content = rendered[code];
+    if (!content)
+        content = renderErrorPage(getErrorPage(code), "text/html");
+    return content;
+}
@@ -0,0 +1,146 @@
+#include "Compressor.hpp"
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+bool    acceptsEncoding(const std::string& header, const char* coding)
+{
+    std::istringstream list(header);
+    std::string item;
+    int star = -1;
+    while (std::getline(list, item, ','))
+    {
+        size_t params = item.find(';');
+        size_t first = item.find_first_not_of(" \t");
+        size_t last = item.find_last_not_of(" \t", params == std::string::npos ? std::string::npos : params - 1);
+        if (first == std::string::npos || last == std::string::npos || first > last)
+            continue;
+        std::string name = item.substr(first, last - first + 1);
+
+        // 'q' is the only parameter defined for content codings
+        bool refused = false;
+        size_t q = params == std::string::npos ? params : item.find_first_not_of(" \t", params + 1);
+        if (q != std::string::npos && (item[q] == 'q' || item[q] == 'Q') && item.compare(q + 1, 1, "=") == 0)
+            refused = std::strtod(item.c_str() + q + 2, NULL) == 0;
+
+        if (strcasecmp(name.c_str(), coding) == 0)
+            return !refused;
+        if (name == "*")
+            star = !refused;
+    }
+    return star == 1;
+}
+
+// "text/html; charset=utf-8" is listed as text/html, "*" matches anything
+bool    isCompressible(const Location& loc, const std::string& type)
+{
+    if (!loc.gzip || type.empty())
+        return false;
+
+    size_t end = type.find_first_of("; \t");
+    if (end == std::string::npos)
+        end = type.size();
+    for (size_t i = 0; i < loc.gzip_types.size(); ++i)
+    {
+        const std::string& listed = loc.gzip_types[i];
+        if (listed == "*")
+            return true;
+        if (listed.size() == end && strncasecmp(listed.c_str(), type.c_str(), end) == 0)
+            return true;
+    }
+    return false;
+}
+
+coding_t    negotiateCoding(const Location& loc, const std::string& acceptEncoding,
+                            const std::string& type, long length)
+{
+    if (!isCompressible(loc, type))
+        return CODING_NONE;
+    if (length >= 0 && length < loc.gzip_min_length)
+        return CODING_NONE;
+    if (acceptsEncoding(acceptEncoding, "gzip"))
+        return CODING_GZIP;
+    if (acceptsEncoding(acceptEncoding, "deflate"))
+        return CODING_DEFLATE;
+    return CODING_NONE;
+}
+
+const char* codingName(coding_t coding)
+{
+    if (coding == CODING_GZIP)
+        return "gzip";
+    if (coding == CODING_DEFLATE)
+        return "deflate";
+    return NULL;
+}
+
+Compressor::Compressor():
+    _active(false),
+    _finished(false),
+    _flush(Z_NO_FLUSH)
+{
+    std::memset(&_zs, 0, sizeof(_zs));
+}
+Compressor::~Compressor() { reset(); }
+
+bool    Compressor::start(coding_t coding, int level)
+{
+    reset();
+    if (coding == CODING_NONE)
+        return false;
+
+    // +16 wraps the stream in a gzip header, "deflate" is the zlib format (RFC 9110 8.4.1.2)
+    int windowBits = coding == CODING_GZIP ? MAX_WBITS + 16 : MAX_WBITS;
+    if (deflateInit2(&_zs, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    _active = true;
+    return true;
+}
+
+bool    Compressor::isActive() const { return _active; }
+
+void    Compressor::write(const char* data, size_t size, bool last)
+{
+    _zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    _zs.avail_in = size;
+    _flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+}
+
+size_t  Compressor::read(char* buff, size_t size)
+{
+    if (!_active || _finished)
+        return 0;
+
+    _zs.next_out = reinterpret_cast<Bytef*>(buff);
+    _zs.avail_out = size;
+    int ret = deflate(&_zs, _flush);
+    // Z_BUF_ERROR only means there was nothing left to flush
+    if (ret != Z_OK && ret != Z_BUF_ERROR)
+        _finished = true;   // Z_STREAM_END, or a stream we can't go on with
+    return size - _zs.avail_out;
+}
+
+void    Compressor::reset()
+{
+    if (_active)
+        deflateEnd(&_zs);
+    std::memset(&_zs, 0, sizeof(_zs));
+    _active = false;
+    _finished = false;
+    _flush = Z_NO_FLUSH;
+}
+
+bool    Compressor::compress(coding_t coding, int level, const std::string& in, std::string& out)
+{
+    Compressor  zs;
+    char        buff[8192];
+
+    if (!zs.start(coding, level))
+        return false;
+    out.clear();
+    zs.write(in.data(), in.size(), true);
+    for (size_t n; (n = zs.read(buff, sizeof(buff))) > 0; )
+        out.append(buff, n);
+    return zs._finished && zs._zs.avail_in == 0;
+}
@@ -0,0 +1,299 @@
+#include "DirListing.hpp"
+#include <algorithm>
+#include <sstream>
+#include <cstdio>
+#include <cctype>
+#include <ctime>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+
+DirCache dirCache;
+
+const char autoindexPrelude[] =
+    "<!DOCTYPE html>\n"
+    "<html lang=\"en\">\n<head>\n"
+    "<meta charset=\"UTF-8\">\n"
+    "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n"
+    "<style>\n"
+    "* { margin: 0; padding: 0; box-sizing: border-box; }\n"
+    "body { font-family: -apple-system, BlinkMacSystemFont, 'Segoe UI', Roboto, 'Helvetica Neue', Arial, sans-serif; background: #f5f5f5; min-height: 100vh; padding: 40px 20px; }\n"
+    ".container { max-width: 900px; margin: 0 auto; }\n"
+    "header { background: white; border-radius: 4px; padding: 30px; box-shadow: 0 1px 3px rgba(0, 0, 0, 0.1); margin-bottom: 32px; }\n"
+    ".status { display: inline-flex; align-items: center; padding: 8px 16px; background: #f0fdf4; color: #166534; border: 1px solid #bbf7d0; border-radius: 3px; font-size: 12px; font-weight: 500; margin-bottom: 20px; text-transform: uppercase; letter-spacing: 0.05em; }\n"
+    ".status::before { content: ''; width: 8px; height: 8px; background: #22c55e; border-radius: 50%; margin-right: 8px; animation: pulse 2s ease-in-out infinite; }\n"
+    "@keyframes pulse { 0%, 100% { opacity: 1; } 50% { opacity: 0.5; } }\n"
+    "h1 { color: #1a1a1a; font-size: 32px; font-weight: 700; letter-spacing: -0.02em; margin-bottom: 8px; }\n"
+    ".subtitle { color: #737373; font-size: 14px; font-family: 'SF Mono', Monaco, 'Courier New', monospace; }\n"
+    ".section { background: white; border-radius: 4px; padding: 32px; box-shadow: 0 1px 3px rgba(0, 0, 0, 0.1); }\n"
+    ".section-title { font-size: 13px; font-weight: 600; text-transform: uppercase; letter-spacing: 0.05em; color: #404040; margin-bottom: 1px; padding-bottom: 12px; border-bottom: 1px solid #e5e5e5; }\n"
+    "table { width: 100%; border-collapse: collapse; }\n"
+    "thead th { text-align: left; padding: 12px 16px; font-size: 12px; font-weight: 600; text-transform: uppercase; letter-spacing: 0.05em; color: #737373; border-bottom: 1px solid #e5e5e5; }\n"
+    "tbody tr { border-bottom: 1px solid #f5f5f5; transition: background-color 0.2s; }\n"
+    "tbody tr:hover { background-color: #fafafa; }\n"
+    "tbody td { padding: 16px; font-size: 14px; color: #1a1a1a; }\n"
+    "tbody td.name { display: flex; align-items: center; gap: 8px; }\n"
+    "tbody td.name a { font-family: 'SF Mono', Monaco, 'Courier New', monospace; }\n"
+    "tbody td.size, tbody td.date { color: #737373; font-size: 13px; }\n"
+    "a { text-decoration: none; color: #1a1a1a; }\n"
+    "a:hover { color: #0066cc; }\n"
+    ".badge { font-size: 11px; padding: 4px 8px; border-radius: 2px; font-weight: 500; text-transform: uppercase; letter-spacing: 0.03em; display: inline-block; }\n"
+    ".badge-dir { background: #fef3c7; color: #92400e; border: 1px solid #fde68a; }\n"
+    ".badge-file { background: #f0f9ff; color: #0369a1; border: 1px solid #bae6fd; }\n"
+    ".info-box { background: #fafafa; border: 1px solid #e5e5e5; border-radius: 3px; padding: 20px; margin-top: 24px; }\n"
+    ".info-title { font-weight: 600; margin-bottom: 8px; font-size: 13px; text-transform: uppercase; letter-spacing: 0.05em; color: #404040; }\n"
+    ".server-info { font-family: 'SF Mono', Monaco, 'Courier New', monospace; font-size: 13px; color: #737373; }\n"
+    ".pages { margin-top: 24px; display: flex; gap: 16px; font-size: 13px; }\n"
+    "</style>\n";
+const size_t autoindexPreludeSize = sizeof(autoindexPrelude) - 1;
+
+std::string htmlEscape(const std::string& s)
+{
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        switch (s[i])
+        {
+            case '<':   out += "&lt;"; break;
+            case '>':   out += "&gt;"; break;
+            case '&':   out += "&amp;"; break;
+            case '"':   out += "&quot;"; break;
+            case '\'':  out += "&#39;"; break;
+            default:    out += s[i];
+        }
+    }
+    return out;
+}
+
+std::string uriEscape(const std::string& s)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        unsigned char c = s[i];
+        if (std::isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~')
+            out += c;
+        else
+        {
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 15];
+        }
+    }
+    return out;
+}
+
+std::string jsonEscape(const std::string& s)
+{
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (c < 0x20)
+        {
+            char buff[8];
+            std::snprintf(buff, sizeof(buff), "\\u%04x", c);
+            out += buff;
+        }
+        else
+            out += c;
+    }
+    return out;
+}
+
+bool    dirEntry::operator<(const dirEntry& other) const
+{
+    if (isDir != other.isDir)
+        return isDir;
+    return name < other.name;
+}
+
+bool    CachedDir::matches(const struct stat& st) const
+{
+    return ino == st.st_ino && mtime == st.st_mtim.tv_sec && mtimeNsec == st.st_mtim.tv_nsec;
+}
+
+static std::string  toString(off_t n)
+{
+    std::ostringstream ss;
+    ss << n;
+    return ss.str();
+}
+
+static std::string  formatSize(off_t size)
+{
+    if (size < 1024)
+        return toString(size) + " B";
+    if (size < 1024 * 1024)
+        return toString(size / 1024) + " KB";
+    if (size < 1024 * 1024 * 1024)
+        return toString(size / (1024 * 1024)) + " MB";
+    return toString(size / (1024 * 1024 * 1024)) + " GB";
+}
+
+static void renderHtmlRow(std::string& out, const dirEntry& e)
+{
+    std::string name = htmlEscape(e.name);
+    char        date[32] = "-";
+    struct tm*  tm = std::localtime(&e.mtime);
+
+    if (tm)
+        std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M", tm);
+
+    out += "<tr>\n<td class=\"name\">";
+    out += e.isDir ? "<span class=\"badge badge-dir\">DIR</span>" : "<span class=\"badge badge-file\">FILE</span>";
+    out += "<a href=\"" + uriEscape(e.name) + (e.isDir ? "/" : "") + "\">" + name + (e.isDir ? "/" : "") + "</a></td>\n";
+    out += "<td class=\"size\">" + (e.isDir ? std::string("-") : formatSize(e.size)) + "</td>\n";
+    out += "<td class=\"date\">" + std::string(date) + "</td>\n</tr>\n";
+}
+
+// every row starts with the ',' separating it from the previous one,
+// a page is sent from right after the first one
+static void renderJsonRow(std::string& out, const dirEntry& e)
+{
+    char        date[64] = "";
+    struct tm*  tm = std::gmtime(&e.mtime);
+
+    if (tm)
+        std::strftime(date, sizeof(date), HTTP_DATE_FORMAT, tm);
+
+    out += ",\n{ \"name\":\"" + jsonEscape(e.name) + "\", \"type\":\"";
+    out += e.isDir ? "directory" : "file";
+    out += "\", \"mtime\":\"" + std::string(date) + "\"";
+    if (!e.isDir)
+        out += ", \"size\":" + toString(e.size);
+    out += " }";
+}
+
+const dirRows&  CachedDir::rows(autoindexFormat format)
+{
+    dirRows& r = format == AUTOINDEX_JSON ? _json : _html;
+    if (r.rows)
+        return r;
+
+    r.rows = contentPtr(new CachedContent);
+    r.offsets.reserve(entries.size() + 1);
+    std::string& data = r.rows->data;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        r.offsets.push_back(data.size());
+        if (format == AUTOINDEX_JSON)
+            renderJsonRow(data, entries[i]);
+        else
+            renderHtmlRow(data, entries[i]);
+    }
+    r.offsets.push_back(data.size());
+    return r;
+}
+
+DirCache::DirCache():
+    _maxEntries(DIR_CACHE_MAX)
+{}
+
+dirPtr  DirCache::get(const filePtr& dir)
+{
+    if (!dir || !dir->isDirectory())
+        return dirPtr();
+
+    map_t::iterator it = _entries.find(dir->path);
+    if (it != _entries.end())
+    {
+        if (it->second.dir->matches(dir->st))
+        {
+            _lru.splice(_lru.begin(), _lru, it->second.pos);
+            return it->second.dir;
+        }
+        _evict(it);
+    }
+
+    dirPtr read = _read(*dir);
+    if (!read || !_maxEntries)
+        return read;
+
+    while (!_lru.empty() && _entries.size() >= _maxEntries)
+        _evict(_entries.find(_lru.back()));
+
+    _lru.push_front(dir->path);
+    node& n = _entries[dir->path];
+    n.dir = read;
+    n.pos = _lru.begin();
+    return read;
+}
+
+// opened beneath the location root like any other file, then one
+// fstatat() per entry relative to it
+dirPtr  DirCache::_read(const CachedFile& file)
+{
+    int fd = file.open(O_RDONLY | O_DIRECTORY);
+    if (fd == -1)
+        return dirPtr();
+    DIR* dir = fdopendir(fd);
+    if (!dir)
+    {
+        close(fd);
+        return dirPtr();
+    }
+
+    dirPtr read(new CachedDir);
+    read->ino = file.st.st_ino;
+    read->mtime = file.st.st_mtim.tv_sec;
+    read->mtimeNsec = file.st.st_mtim.tv_nsec;
+
+    struct dirent*  ent;
+    struct stat     st;
+    while ((ent = readdir(dir)))
+    {
+        std::string name = ent->d_name;
+        if (name == "." || name == "..")
+            continue;
+        if (fstatat(fd, ent->d_name, &st, 0) != 0)
+            continue;
+
+        dirEntry e;
+        e.name = name;
+        e.isDir = S_ISDIR(st.st_mode);
+        e.size = st.st_size;
+        e.mtime = st.st_mtime;
+        read->entries.push_back(e);
+    }
+    closedir(dir);
+
+    std::sort(read->entries.begin(), read->entries.end());
+    return read;
+}
+
+// responses still sending rows keep them alive
+void    DirCache::_evict(map_t::iterator it)
+{
+    _lru.erase(it->second.pos);
+    _entries.erase(it);
+}
+
+void    DirCache::invalidate(const std::string& path)
+{
+    map_t::iterator it = _entries.find(path);
+    if (it != _entries.end())
+        _evict(it);
+}
+
+void    DirCache::clear()
+{
+    _entries.clear();
+    _lru.clear();
+}
+
+void    DirCache::setMaxEntries(size_t max)
+{
+    _maxEntries = max;
+    while (!_lru.empty() && _entries.size() > _maxEntries)
+        _evict(_entries.find(_lru.back()));
+}
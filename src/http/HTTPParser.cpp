@@ -3,6 +3,7 @@
 #include <cstdio>
 
 HTTPParser::HTTPParser():
+    _uriRewritten(false),
     _body(BUFF_SIZE * 16),
     _contentLength(0),
     _bytesRead(0),
@@ -23,6 +24,7 @@ HTTPParser::HTTPParser():
 
 std::string&    HTTPParser::getMethod(void) { return _method; }
 std::string&    HTTPParser::getVers(void) { return _version; }
+bool            HTTPParser::isUriRewritten(void) { return _uriRewritten; }
 std::string&    HTTPParser::getUri(void) { return _uri; }
 std::string&    HTTPParser::getQuery(void) { return _query; }
 std::string&    HTTPParser::getFragment(void) { return _fragment; }
@@ -55,6 +57,9 @@ void    HTTPParser::reset(void)
 {
     _method.clear();
     _uri.clear();
+    _query.clear();
+    _fragment.clear();
+    _uriRewritten = false;
     _version.clear();
     _body.clear();
     _headers.clear();
@@ -166,20 +171,6 @@ void    HTTPParser::_parseStartLine()
         return;
 
     _decodeURI();
-    if (_state == ERROR)
-        return;
-    size_t fragm = _uri.find('#');
-    if (fragm != NPOS)
-    {
-        _fragment = _uri.substr(fragm + 1);
-        _uri = _uri.erase(fragm);
-    }
-    size_t query = _uri.find('?');
-    if (query != NPOS)
-    {
-        _query = _uri.substr(query + 1);
-        _uri = _uri.substr(0, query);
-    }
 }
 void    HTTPParser::_parseHeaders()
 {
@@ -368,31 +359,97 @@ void    HTTPParser::setBodyHandler(bodyHandler bh, void *data)
 }
 void    HTTPParser::setUploadDir(const std::string& dir) { _MultiParser.setUploadPath(dir); }
 
+static int  hexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/*
+    one pass over the request target:
+        - split off '?query' and '#fragment' (both kept raw, CGI wants QUERY_STRING undecoded)
+        - decode %XX in the path, '%4' or '%zz' or '%00' is a bad request
+        - collapse '//', drop '.' segments and resolve '..' segments, a '..'
+          above the root is dropped too
+    the path is rewritten in place ('w' never passes 'r'), so the router gets
+    an already normalized path and never has to clean it again. the last
+    step is remembered, the client is redirected to the normal form then.
+*/
 void    HTTPParser::_decodeURI()
 {
-    std::string tmp;
-    long        nbr;
+    size_t end = _uri.find_first_of("?#");
+    if (end != NPOS)
+    {
+        size_t fragm = _uri.find('#', end);
+        if (fragm != NPOS)
+            _fragment.assign(_uri, fragm + 1, NPOS);
+        if (_uri[end] == '?')
+            _query.assign(_uri, end + 1, fragm == NPOS ? NPOS : fragm - end - 1);
+    }
+    else
+        end = _uri.size();
 
-    for (size_t i = 0; i < _uri.size(); ++i)
+    if (!end || _uri[0] != '/')
     {
-        if (_uri[i] != '%')
-            continue;
-        // '/%A' means a bad request
-        if (i + 2 >= _uri.size())
+        _state = ERROR;
+        return;
+    }
+
+    size_t  w = 1;      // write position
+    size_t  seg = 1;    // start of the segment being written
+    for (size_t r = 1; r <= end; )
+    {
+        char c = '/';   // the end of the path closes the last segment
+        if (r < end)
         {
-            _state = ERROR;
-            return;
+            c = _uri[r++];
+            if (c == '%')
+            {
+                int hi = r + 1 < end ? hexValue(_uri[r]) : -1;
+                int lo = r + 1 < end ? hexValue(_uri[r + 1]) : -1;
+                if (hi < 0 || lo < 0 || (hi | lo) == 0)
+                {
+                    _state = ERROR;
+                    return;
+                }
+                c = static_cast<char>((hi << 4) | lo);
+                r += 2;
+            }
+            if (c != '/')
+            {
+                _uri[w++] = c;
+                continue;
+            }
         }
-        tmp = _uri.substr(i + 1, 2);
-        nbr = std::strtol(tmp.c_str(), NULL, 16);
-        if (!isascii(nbr))
+        else
+            ++r;
+
+        size_t len = w - seg;
+        if (len == 2 && _uri[seg] == '.' && _uri[seg + 1] == '.')
         {
-            _state = ERROR;
-            return;
+            w = seg;
+            if (seg > 1) // not above the root
+            {
+                --w;
+                while (_uri[w - 1] != '/')
+                    --w;
+            }
+            _uriRewritten = true;
+        }
+        else if (len == 1 && _uri[seg] == '.')
+        {
+            w = seg;
+            _uriRewritten = true;
         }
-        tmp = nbr;
-        _uri.replace(i, 3, tmp);
+        else if (len && r <= end)
+            _uri[w++] = '/';
+        else if (!len && r <= end) // '//'
+            _uriRewritten = true;
+        seg = w;
     }
+    _uri.resize(w);
 }
 
 void    HTTPParser::parseMultipart()
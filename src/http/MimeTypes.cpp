@@ -0,0 +1,132 @@
+#include "MimeTypes.hpp"
+#include <cctype>
+
+#define INITIAL_SLOTS 64
+
+MimeTypes mimeTypes;
+
+MimeTypes::MimeTypes():
+    _table(INITIAL_SLOTS),
+    _count(0),
+    _default(DEFAULT_MIME_TYPE)
+{
+    // Text types
+    add("html", "text/html");
+    add("htm", "text/html");
+    add("css", "text/css");
+    add("js", "application/javascript");
+    add("json", "application/json");
+    add("xml", "application/xml");
+    add("txt", "text/plain");
+
+    // Image types
+    add("jpg", "image/jpeg");
+    add("jpeg", "image/jpeg");
+    add("png", "image/png");
+    add("gif", "image/gif");
+    add("svg", "image/svg+xml");
+    add("ico", "image/x-icon");
+    add("webp", "image/webp");
+
+    // Font types
+    add("woff", "font/woff");
+    add("woff2", "font/woff2");
+    add("ttf", "font/ttf");
+    add("otf", "font/otf");
+
+    // Other
+    add("pdf", "application/pdf");
+    add("zip", "application/zip");
+}
+
+// FNV-1a over the lowercased extension
+size_t  MimeTypes::_hash(const char* ext, size_t len)
+{
+    size_t h = 2166136261u;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(ext[i])));
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// the slot holding 'ext', or the empty slot where it would go
+size_t  MimeTypes::_slot(const char* ext, size_t len) const
+{
+    size_t mask = _table.size() - 1;
+    size_t i = _hash(ext, len) & mask;
+
+    while (!_table[i].ext.empty())
+    {
+        const std::string& key = _table[i].ext;
+        if (key.size() == len)
+        {
+            size_t j = 0;
+            while (j < len && key[j] == std::tolower(static_cast<unsigned char>(ext[j])))
+                ++j;
+            if (j == len)
+                break;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+void    MimeTypes::_grow()
+{
+    std::vector<entry> old(_table.size() * 2);
+    old.swap(_table);
+    for (size_t i = 0; i < old.size(); ++i)
+    {
+        if (old[i].ext.empty())
+            continue;
+        entry& e = _table[_slot(old[i].ext.data(), old[i].ext.size())];
+        e.ext.swap(old[i].ext);
+        e.type.swap(old[i].type);
+    }
+}
+
+void    MimeTypes::add(const std::string& ext, const std::string& type)
+{
+    if (ext.empty())
+        return;
+    // keep the load under 1/2 so probe chains stay short
+    if ((_count + 1) * 2 > _table.size())
+        _grow();
+
+    entry& e = _table[_slot(ext.data(), ext.size())];
+    if (e.ext.empty())
+    {
+        e.ext = ext;
+        for (size_t i = 0; i < e.ext.size(); ++i)
+            e.ext[i] = std::tolower(static_cast<unsigned char>(e.ext[i]));
+        ++_count;
+    }
+    e.type = type;
+}
+
+void    MimeTypes::clear()
+{
+    std::vector<entry>(INITIAL_SLOTS).swap(_table);
+    _count = 0;
+}
+
+size_t  MimeTypes::size() const { return _count; }
+
+const std::string&  MimeTypes::find(const char* ext, size_t len) const
+{
+    if (!len)
+        return _default;
+
+    const entry& e = _table[_slot(ext, len)];
+    return e.ext.empty() ? _default : e.type;
+}
+
+const std::string&  MimeTypes::lookup(const std::string& path) const
+{
+    size_t dot = path.find_last_of("./");
+    if (dot == std::string::npos || path[dot] != '.')
+        return _default;
+    return find(path.data() + dot + 1, path.size() - dot - 1);
+}
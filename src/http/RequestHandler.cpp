@@ -1,14 +1,21 @@
 #include "RequestHandler.hpp"
 
-RequestHandler::RequestHandler(ServerConfig &config, HTTPParser& req, HTTPResponse& resp, FdManager &fdManager):
-    _router(config),
+RequestHandler::RequestHandler(VirtualHosts &hosts, HTTPParser& req, HTTPResponse& resp, FdManager &fdManager, int clientFd):
+    _hosts(hosts),
+    _router(hosts.getDefault()),
+    _isRouted(false),
+    _tryStatus(0),
+    _isTried(false),
     _request(req),
     _response(resp),
-    _cgi(_request,_response,config,fdManager),
+    _cgi(_request,_response,hosts.getDefault(),fdManager,clientFd),
     _cgiSrtartTime(0),
+    _cgiStarted(false),
     _keepAlive(false),
     _isCGI(false),
     _isDirSet(false),
+    _expectChecked(false),
+    _sendContinue(false),
     responseStarted(false)
 {}
 RequestHandler::~RequestHandler() 
@@ -37,7 +44,6 @@ bool    RequestHandler::isError() { return _request.isError(); }
 
 size_t  RequestHandler::readNextChunk(char *buff, size_t size)
 {
-    const RouteMatch& match = _router.match(_request.getUri(), _request.getMethod());
 	//logger.debug("cgi timeout: " + intToString(match.location->cgi_timeout));
     //logger.debug("time diff: " + intToString(static_cast<int>(difftime(time(NULL), _cgiSrtartTime))));
     //logger.debug("time now: " + intToString(static_cast<int>(time(NULL))));
@@ -64,6 +70,12 @@ size_t  RequestHandler::readNextChunk(char *buff, size_t size)
     return _response.readNextChunk(buff, size);
 }
 
+void    RequestHandler::resumeCGI()
+{
+    if (_isCGI)
+        _cgi.resume();
+}
+
 void    RequestHandler::reset()
 {
     logger.warning("Resetting RequestHandler state");
@@ -71,11 +83,24 @@ void    RequestHandler::reset()
     _request.reset();
     _response.reset();
     _isDirSet = false;
+    _isRouted = false;
+    _match = RouteMatch();
+    _isTried = false;
+    _tryMatch = RouteMatch();
+    _tryStatus = 0;
+    _router.setServer(_hosts.getDefault());
+    _expectChecked = false;
+    _sendContinue = false;
+    _cgiStarted = false;
     _cgi.reset();
 }
 
 bool    RequestHandler::keepAlive()
 {
+    // the rest of a rejected body may still be on the wire
+    if (_request.isError())
+        return false;
+
     std::string conn = _request.getHeader("connection");
     std::transform(conn.begin(), conn.end(), conn.begin(), ::tolower);
 
@@ -84,12 +109,40 @@ bool    RequestHandler::keepAlive()
     return conn == "keep-alive";
 }
 
+// processRequest() runs again for every piece of a body, the route and the
+// stat behind it stay the same for the whole request
+const RouteMatch&   RequestHandler::_route()
+{
+    if (!_isRouted)
+    {
+        // errors before this point use the default server's pages
+        _router.setServer(_hosts.find(_request.getHeader("host")));
+        _match = _router.match(_request.getUri(), _request.getMethod());
+        _isCGI = _match.isCGI;
+        _isRouted = true;
+    }
+    return _match;
+}
+
 bool    RequestHandler::processRequest()
 {
     _keepAlive = keepAlive();
 
-    const RouteMatch& match = _router.match(_request.getUri(), _request.getMethod());
-    
+    const RouteMatch& match = _route();
+
+    if (!_expectChecked)
+    {
+        _expectChecked = true;
+        int code = _checkExpectation(match);
+        if (code)
+        {
+            logger.error("Expectation rejected: " + _request.getUri());
+            _sendErrorResponse(code);
+            _request.forceError();
+            return true;
+        }
+    }
+
     if (!match.isValidMatch())
     {
         logger.error("Not a valid match: " + _request.getUri());
@@ -103,7 +156,6 @@ bool    RequestHandler::processRequest()
         return true;
     }
 
-    _isCGI = match.isCGI;
     const std::string& method = _request.getMethod();
     logger.debug("rquest method : " + method);
     if (method == "GET")
@@ -126,8 +178,12 @@ void RequestHandler::_common(const RouteMatch& match)
 
     if (match.isDirectory && expectedUri[expectedUri.size() - 1] != '/')
         expectedUri += '/';
+    else if (!match.isDirectory && expectedUri.size() > 1 && expectedUri[expectedUri.size() - 1] == '/')
+        expectedUri.erase(expectedUri.size() - 1);
 
-    if (_request.getUri() != expectedUri)
+    // the parser normalized the path already, the client still gets
+    // redirected to the form it should have asked for
+    if (_request.isUriRewritten() || _request.getUri() != expectedUri)
     {
         std::string cleanUri = expectedUri;
         const std::string& query = _request.getQuery();
@@ -149,6 +205,11 @@ void RequestHandler::_common(const RouteMatch& match)
         _response.endHeaders();
         return;
     }
+    if (!match.location->tryFiles.empty())
+    {
+        _tryFiles(match);
+        return;
+    }
     if (!match.doesExist)
     {
         logger.error("match does not exist: " + match.fsPath);
@@ -171,7 +232,7 @@ void    RequestHandler::_handleGET(const RouteMatch& match)
 {
     // 1. just does common stuff like file or dict serving
     if (_isCGI)
-        _handleCGI(match);
+        _handleCGI(_isTried ? _tryMatch : match);
     else
     {
         logger.debug("handle GET common is called");
@@ -190,8 +251,16 @@ void    RequestHandler::_handlePOST(const RouteMatch& match)
     if (_request.getBodySize() > match.maxBodySize)
     {
         logger.error("max body size reached");
-        _sendErrorResponse(413);
         _request.forceError();
+        // a chunked body can go over once the script already has part of it,
+        // and the client part of its output: there's no room for another
+        // response then, the connection is closed
+        if (_cgiStarted)
+            _cgi.abort(413);
+        if (responseStarted)
+            _response.reset();
+        else
+            _sendErrorResponse(413);
         return;
     }
     if (match.isUploadAllowed() && _request.isMultiPart())
@@ -216,7 +285,7 @@ void    RequestHandler::_handlePOST(const RouteMatch& match)
         return;
     }
     if (_isCGI)
-        _handleCGI(match);
+        _handleCGI(_isTried ? _tryMatch : match);
     else
         _common(match);
 }
@@ -237,8 +306,9 @@ void    RequestHandler::_handleDELETE(const RouteMatch& match)
         _sendErrorResponse(403);
         return;
     }
-    if (unlink(match.fsPath.c_str()) == 0)
+    if (match.file->unlink() == 0)
     {
+        fileCache.invalidate(match.fsPath);
         logger.success("file wad deleted: " + match.fsPath);
         _response.startLine(204);
         _response.endHeaders();
@@ -252,16 +322,88 @@ void    RequestHandler::_sendErrorResponse(int code)
 {
     _response.reset();
     _response.startLine(code);
-    if (!_response.attachFile(_router.getErrorPage(code)))
-        _response.setBody(getErrorPage(code));
+    if (!keepAlive())
+        _response.addHeader("Connection", "close");
+    _response.attachContent(_router.getErrorPage(code));
 }
 
 void    RequestHandler::_serveFile(const RouteMatch& path)
 {
+    _sendFile(path.file, path.gzipStatic);
+}
+// with gzip_static the compressed sibling is sent in place of the file, under
+// the file's own Content-type. validators and ranges apply to what's sent
+void    RequestHandler::_sendFile(const filePtr& original, bool gzipStatic)
+{
+    const char* encoding = NULL;
+    filePtr file = original;
+    if (gzipStatic)
+    {
+        filePtr compressed = _findPrecompressed(original, encoding);
+        if (compressed)
+            file = compressed;
+    }
+    const std::string& type = original->type;
+
+    if (_request.getMethod() == "GET" && _isNotModified(*file))
+    {
+        _response.startLine(304);
+        if (gzipStatic)
+            _response.addHeader("Vary", "Accept-Encoding");
+        _response.addHeader("ETag", file->etag);
+        _response.addHeader("Last-Modified", file->lastModified);
+        _response.endHeaders();
+        return;
+    }
+
+    ranges_t ranges;
+    int status = _request.getMethod() == "GET" ? _parseRanges(*file, ranges) : 200;
+    if (status == 416)
+    {
+        _response.startLine(416);
+        _response.addHeader("Content-Range", "bytes */" + SSTR(file->st.st_size));
+        _response.addHeader("content-length", "0");
+        _response.endHeaders();
+        return;
+    }
+    if (status == 206)
+    {
+        _response.startLine(206);
+        if (encoding)
+            _response.addHeader("Content-Encoding", encoding);
+        if (gzipStatic)
+            _response.addHeader("Vary", "Accept-Encoding");
+        _response.addHeader("ETag", file->etag);
+        _response.addHeader("Last-Modified", file->lastModified);
+        bool attached = ranges.size() == 1
+            ? _response.attachRange(file, type, ranges[0].first, ranges[0].second)
+            : _response.attachRanges(file, type, ranges);
+        if (!attached)
+        {
+            logger.error("cant send file: " + file->path);
+            _sendErrorResponse(403);
+        }
+        return;
+    }
+
     _response.startLine(200);
-    if (!_response.attachFile(path.fsPath))
+    if (encoding)
+        _response.addHeader("Content-Encoding", encoding);
+    if (gzipStatic)
+        _response.addHeader("Vary", "Accept-Encoding");
+
+    contentPtr content = contentCache.get(file, type);
+    if (content)
+    {
+        _response.attachContent(content);
+        return;
+    }
+    _response.addHeader("Accept-Ranges", "bytes");
+    _response.addHeader("ETag", file->etag);
+    _response.addHeader("Last-Modified", file->lastModified);
+    if (!_response.attachFile(file, type))
     {
-        logger.error("cant send file: " + path.fsPath);
+        logger.error("cant send file: " + file->path);
         _sendErrorResponse(403);
     }
 }
@@ -270,164 +412,431 @@ void    RequestHandler::_serveDict(const RouteMatch& path)
     //    - Check autoindex
     //    - Try index files
     //    - 403 if neither
-    _response.startLine(200);
     if (path.autoIndex)
     {
-        _response.setBody(_getDictListing(path.fsPath));
+        if (!_sendListing(path))
+        {
+            logger.error("Failed to open directory: " + path.fsPath);
+            _sendErrorResponse(403);
+        }
         return;
     }
     for (size_t i = 0; i < path.indexFiles.size(); ++i)
     {
-        if (_response.attachFile(path.fsPath + '/' + path.indexFiles[i]))
+        filePtr index = _router.lookup(*path.location, path.fsPath + '/' + path.indexFiles[i]);
+        if (index->fd != -1)
+        {
+            _sendFile(index, path.gzipStatic);
             return;
+        }
     }
     _sendErrorResponse(403);
 }
 
-std::string RequestHandler::_getDictListing(const std::string& path)
+// "page=N" in the query string, the first page if it's missing or not a number
+static size_t   listingPage(const std::string& query)
 {
-    DIR* dir = opendir(path.c_str());
+    size_t pos = 0;
+    while (pos < query.size())
+    {
+        if (query.compare(pos, 5, "page=") == 0)
+        {
+            long page = std::atol(query.c_str() + pos + 5);
+            return page > 0 ? page : 1;
+        }
+        pos = query.find('&', pos);
+        if (pos == NPOS)
+            break;
+        ++pos;
+    }
+    return 1;
+}
+
+static void     attachOwned(HTTPResponse& response, const std::string& data)
+{
+    contentPtr owner(new CachedContent);
+    owner->data = data;
+    response.attachSegment(owner->data.data(), owner->data.size(), owner);
+}
+
+// autoindex: the rows come from the directory cache, rendered once per
+// directory, and are sent from there as one slice per page. only the head
+// and the tail around them are built per request, the css is a constant.
+// false if the directory can't be read
+bool    RequestHandler::_sendListing(const RouteMatch& match)
+{
+    dirPtr dir = dirCache.get(match.file);
     if (!dir)
+        return false;
+
+    const Location& loc = *match.location;
+    bool            json = loc.autoindex_format == AUTOINDEX_JSON;
+    const dirRows&  rows = dir->rows(loc.autoindex_format);
+    size_t          count = dir->entries.size();
+    size_t          pageSize = loc.autoindex_page_size ? loc.autoindex_page_size : count;
+    size_t          pages = pageSize ? (count + pageSize - 1) / pageSize : 1;
+    size_t          page = listingPage(_request.getQuery());
+
+    if (page > std::max(pages, size_t(1)))
     {
-        logger.error("Failed to open directory: " + path);
-        return "";
-    }
-
-    std::string reqUri = _request.getUri();
-
-    // final html code
-    std::string html;
-    html.reserve(BUFF_SIZE * 2);
-
-    html += "<!DOCTYPE html>\n";
-    html += "<html lang=\"en\">\n<head>\n";
-    html += "<meta charset=\"UTF-8\">\n";
-    html += "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n";
-    html += "<title>Index of " + reqUri + "</title>\n";
-    html += "<style>\n";
-    html += "* { margin: 0; padding: 0; box-sizing: border-box; }\n";
-    html += "body { font-family: -apple-system, BlinkMacSystemFont, 'Segoe UI', Roboto, 'Helvetica Neue', Arial, sans-serif; background: #f5f5f5; min-height: 100vh; padding: 40px 20px; }\n";
-    html += ".container { max-width: 900px; margin: 0 auto; }\n";
-    html += "header { background: white; border-radius: 4px; padding: 30px; box-shadow: 0 1px 3px rgba(0, 0, 0, 0.1); margin-bottom: 32px; }\n";
-    html += ".status { display: inline-flex; align-items: center; padding: 8px 16px; background: #f0fdf4; color: #166534; border: 1px solid #bbf7d0; border-radius: 3px; font-size: 12px; font-weight: 500; margin-bottom: 20px; text-transform: uppercase; letter-spacing: 0.05em; }\n";
-    html += ".status::before { content: ''; width: 8px; height: 8px; background: #22c55e; border-radius: 50%; margin-right: 8px; animation: pulse 2s ease-in-out infinite; }\n";
-    html += "@keyframes pulse { 0%, 100% { opacity: 1; } 50% { opacity: 0.5; } }\n";
-    html += "h1 { color: #1a1a1a; font-size: 32px; font-weight: 700; letter-spacing: -0.02em; margin-bottom: 8px; }\n";
-    html += ".subtitle { color: #737373; font-size: 14px; font-family: 'SF Mono', Monaco, 'Courier New', monospace; }\n";
-    html += ".section { background: white; border-radius: 4px; padding: 32px; box-shadow: 0 1px 3px rgba(0, 0, 0, 0.1); }\n";
-    html += ".section-title { font-size: 13px; font-weight: 600; text-transform: uppercase; letter-spacing: 0.05em; color: #404040; margin-bottom: 1px; padding-bottom: 12px; border-bottom: 1px solid #e5e5e5; }\n";
-    html += "table { width: 100%; border-collapse: collapse; }\n";
-    html += "thead th { text-align: left; padding: 12px 16px; font-size: 12px; font-weight: 600; text-transform: uppercase; letter-spacing: 0.05em; color: #737373; border-bottom: 1px solid #e5e5e5; }\n";
-    html += "tbody tr { border-bottom: 1px solid #f5f5f5; transition: background-color 0.2s; }\n";
-    html += "tbody tr:hover { background-color: #fafafa; }\n";
-    html += "tbody td { padding: 16px; font-size: 14px; color: #1a1a1a; }\n";
-    html += "tbody td.name { display: flex; align-items: center; gap: 8px; }\n";
-    html += "tbody td.name a { font-family: 'SF Mono', Monaco, 'Courier New', monospace; }\n";
-    html += "tbody td.size, tbody td.date { color: #737373; font-size: 13px; }\n";
-    html += "a { text-decoration: none; color: #1a1a1a; }\n";
-    html += "a:hover { color: #0066cc; }\n";
-    html += ".badge { font-size: 11px; padding: 4px 8px; border-radius: 2px; font-weight: 500; text-transform: uppercase; letter-spacing: 0.03em; display: inline-block; }\n";
-    html += ".badge-dir { background: #fef3c7; color: #92400e; border: 1px solid #fde68a; }\n";
-    html += ".badge-file { background: #f0f9ff; color: #0369a1; border: 1px solid #bae6fd; }\n";
-    html += ".info-box { background: #fafafa; border: 1px solid #e5e5e5; border-radius: 3px; padding: 20px; margin-top: 24px; }\n";
-    html += ".info-title { font-weight: 600; margin-bottom: 8px; font-size: 13px; text-transform: uppercase; letter-spacing: 0.05em; color: #404040; }\n";
-    html += ".server-info { font-family: 'SF Mono', Monaco, 'Courier New', monospace; font-size: 13px; color: #737373; }\n";
-    html += "</style>\n";
-    html += "</head>\n<body>\n";
-    html += "<div class=\"container\">\n";
-    html += "<header>\n";
-    html += "<div class=\"status\">Directory Listing</div>\n";
-    html += "<h1>Index of " + reqUri + "</h1>\n";
-    html += "<div class=\"subtitle\">WebSrv 1.0</div>\n";
-    html += "<div class=\"info-box\">\n";
-    html += "<div class=\"info-title\">System Path</div>\n";
-    html += "<div class=\"server-info\">" + path + "</div>\n";
-    html += "</div>\n";
-    html += "</header>\n";
-    html += "<div class=\"section\">\n";
-    html += "<div class=\"section-title\">Contents</div>\n";
-    html += "<table>\n";
-    html += "<thead>\n<tr>\n";
-    html += "<th>Name</th>\n";
-    html += "<th>Size</th>\n";
-    html += "<th>Last Modified</th>\n";
-    html += "</tr>\n</thead>\n<tbody>\n";
-
-    // this will be used to store entries data
-    std::vector<fileInfo> entries;
-
-    // collect entries
-    dirent *entry = NULL;
-    while ((entry = readdir(dir)))
-    {
-        fileInfo info;
-        info.name = entry->d_name;
-        if (info.name == ".")
-            continue;
-        std::string epath = path + '/' + info.name;
-        if (stat(epath.c_str(), &info.data) == 0)
-            entries.push_back(info);
+        _sendErrorResponse(404);
+        return true;
+    }
+    size_t first = (page - 1) * pageSize;
+    size_t last = std::min(count, first + pageSize);
+    size_t from = rows.offsets[first];
+    size_t to = rows.offsets[last];
+    if (json && from < to)
+        ++from; // the first row of the page has no ',' before it
+
+    std::string uri = htmlEscape(match.normURI);
+    std::string head;
+    std::string tail;
+    if (json)
+    {
+        head = "[";
+        tail = "\n]\n";
+    }
+    else
+    {
+        head = "<title>Index of " + uri + "</title>\n</head>\n<body>\n"
+               "<div class=\"container\">\n<header>\n"
+               "<div class=\"status\">Directory Listing</div>\n"
+               "<h1>Index of " + uri + "</h1>\n"
+               "<div class=\"subtitle\">WebSrv 1.0</div>\n"
+               "<div class=\"info-box\">\n<div class=\"info-title\">System Path</div>\n"
+               "<div class=\"server-info\">" + htmlEscape(match.fsPath) + "</div>\n</div>\n"
+               "</header>\n<div class=\"section\">\n<div class=\"section-title\">Contents</div>\n"
+               "<table>\n<thead>\n<tr>\n<th>Name</th>\n<th>Size</th>\n<th>Last Modified</th>\n"
+               "</tr>\n</thead>\n<tbody>\n";
+        if (match.normURI != "/")
+            head += "<tr>\n<td class=\"name\"><span class=\"badge badge-dir\">DIR</span>"
+                    "<a href=\"../\">../</a></td>\n<td class=\"size\">-</td>\n<td class=\"date\">-</td>\n</tr>\n";
+        tail = "</tbody>\n</table>\n";
+        if (pages > 1)
+        {
+            tail += "<div class=\"pages\">";
+            if (page > 1)
+                tail += "<a href=\"?page=" + SSTR(page - 1) + "\">&larr; previous</a>";
+            tail += "<span>page " + SSTR(page) + " of " + SSTR(pages) + "</span>";
+            if (page < pages)
+                tail += "<a href=\"?page=" + SSTR(page + 1) + "\">next &rarr;</a>";
+            tail += "</div>\n";
+        }
+        tail += "</div>\n</div>\n</body>\n</html>";
     }
-    closedir(dir);
 
-    // sort this shit, dicts first, then alphabitcly
-    std::sort(entries.begin(), entries.end());
+    const char* type = json ? "application/json" : "text/html";
+    const char* prelude = json ? "" : autoindexPrelude;
+    size_t      preludeSize = json ? 0 : autoindexPreludeSize;
+    size_t      length = preludeSize + head.size() + (to - from) + tail.size();
+    coding_t    coding = negotiateCoding(loc, _request.getHeader("accept-encoding"), type, length);
 
-    // build the html
-    for (size_t i = 0; i < entries.size(); ++i)
+    _response.startLine(200);
+    if (isCompressible(loc, type))
+        _response.addHeader("Vary", "Accept-Encoding");
+    if (page > 1)
+        _response.addHeader("Link", "<?page=" + SSTR(page - 1) + ">; rel=\"prev\"");
+    if (page < pages)
+        _response.addHeader("Link", "<?page=" + SSTR(page + 1) + ">; rel=\"next\"");
+
+    // compressing needs the whole body in one piece anyway, it's sent
+    // from memory too since it can outgrow the response buffer
+    if (coding != CODING_NONE)
     {
-        bool isDir = entries[i].data.st_mode & S_ISDIR(entries[i].data.st_mode);
-        std::string link = reqUri + entries[i].name;
+        std::string body;
+        contentPtr  compressed(new CachedContent);
+        body.reserve(length);
+        body.append(prelude, preludeSize).append(head).append(rows.rows->data, from, to - from).append(tail);
+        if (Compressor::compress(coding, loc.gzip_comp_level, body, compressed->data))
+        {
+            _response.addHeader("Content-Encoding", codingName(coding));
+            _response.addHeader("content-type", type);
+            _response.addHeader("content-length", compressed->data.size());
+            _response.endHeaders();
+            _response.attachSegment(compressed->data.data(), compressed->data.size(), compressed);
+            return true;
+        }
+    }
+
+    _response.addHeader("content-type", type);
+    _response.addHeader("content-length", length);
+    _response.endHeaders();
+    if (preludeSize)
+        _response.attachSegment(prelude, preludeSize);
+    attachOwned(_response, head);
+    if (to > from)
+        _response.attachSegment(rows.rows->data.data() + from, to - from, rows.rows);
+    attachOwned(_response, tail);
+    return true;
+}
+
+// gzip_static: a pre-built "file.br" or "file.gz" next to the file, brotli first
+filePtr RequestHandler::_findPrecompressed(const filePtr& file, const char*& encoding)
+{
+    static const char* codings[] = { "br", "gzip" };
+    static const char* suffixes[] = { ".br", ".gz" };
 
-        std::string sizeStr = "-";
-        std::string dateStr = "-";
+    strmap& headers = _request.getHeaders();
+    strmap::iterator it = headers.find("accept-encoding");
+    if (it == headers.end() || !file->isFile())
+        return filePtr();
 
-        // format size
-        if (!isDir)
+    for (size_t i = 0; i < 2; ++i)
+    {
+        if (!acceptsEncoding(it->second, codings[i]))
+            continue;
+        filePtr compressed = fileCache.get(file->path + suffixes[i], file->rootFd, file->rootLen);
+        if (compressed->isFile() && compressed->fd != -1)
         {
-            size_t fileSize = entries[i].data.st_size;
-            if (fileSize < 1024)
-                sizeStr = SSTR(fileSize) + " B";
-            else if (fileSize < 1024 * 1024)
-                sizeStr = SSTR(fileSize / 1024) + " KB";
-            else if (fileSize < 1024 * 1024 * 1024)
-                sizeStr = SSTR(fileSize / (1024 * 1024)) + " MB";
-            else
-                sizeStr = SSTR(fileSize / (1024 * 1024 * 1024)) + " GB";
+            encoding = codings[i];
+            return compressed;
         }
+    }
+    return filePtr();
+}
 
-        // format time
-        char timeBuff[100];
-        struct tm *time = std::localtime(&entries[i].data.st_mtime);
-        if (time)
+// "$uri" stands for the request path
+static std::string expandTryFile(const std::string& entry, const std::string& uri)
+{
+    std::string res = entry;
+    for (size_t pos = 0; (pos = res.find("$uri", pos)) != NPOS; pos += uri.size())
+        res.replace(pos, 4, uri);
+    return res;
+}
+
+// try_files: the first candidate found through the file cache is served, a
+// trailing '/' asks for a directory. the fallback is either an error code or
+// a uri routed again and served as is, its own try_files isn't applied
+// the candidates are looked up for the first piece of the request only, a
+// body coming in afterwards goes where the first one went
+void    RequestHandler::_resolveTryFiles(const RouteMatch& match)
+{
+    const std::vector<std::string>& list = match.location->tryFiles;
+
+    _isTried = true;
+    for (size_t i = 0; i + 1 < list.size(); ++i)
+    {
+        std::string uri = expandTryFile(list[i], match.normURI);
+        bool        wantDir = uri[uri.size() - 1] == '/';
+        filePtr     file = _router.lookup(*match.location, _router.resolvePath(*match.location, uri));
+
+        if (wantDir ? file->isDirectory() : file->isFile())
         {
-            std::strftime(timeBuff, sizeof(timeBuff), "%Y-%m-%d %H:%M", time);
-            dateStr = timeBuff;
+            // served as is, even from a cgi location
+            _tryMatch = match;
+            _tryMatch.fsPath = file->path;
+            _tryMatch.file = file;
+            _tryMatch.doesExist = true;
+            _tryMatch.isDirectory = wantDir;
+            _tryMatch.isFile = !wantDir;
+            _tryMatch.isCGI = false;
+            return;
         }
+    }
 
-        html += "<tr>\n";
-        html += "<td class=\"name\">";
-        html += "<span class=\"badge badge-" + std::string(isDir ? "dir" : "file") + "\">" +
-                std::string(isDir ? "DIR" : "FILE") + "</span>";
-        html += "<a href=\"" + link + "\">" + entries[i].name +
-                (isDir ? "/" : "") + "</a></td>\n";
-        html += "<td class=\"size\">" + sizeStr + "</td>\n";
-        html += "<td class=\"date\">" + dateStr + "</td>\n";
-        html += "</tr>\n";
+    const std::string& fallback = list.back();
+    if (fallback[0] == '=')
+    {
+        _tryStatus = std::atoi(fallback.c_str() + 1);
+        return;
     }
 
-    html += "</table>\n</div>\n</div>\n</body>\n</html>";
+    _tryMatch = _router.match(expandTryFile(fallback, match.normURI), _request.getMethod());
+    if (!_tryMatch.isValidMatch() || !_tryMatch.methodAllowed)
+        _tryStatus = _tryMatch.isValidMatch() ? 405 : 404;
+    else if (!_tryMatch.isCGI && !_tryMatch.isFile && !_tryMatch.isDirectory)
+        _tryStatus = 404;
+}
 
-    return html;
+void    RequestHandler::_tryFiles(const RouteMatch& match)
+{
+    if (!_isTried)
+        _resolveTryFiles(match);
+
+    if (_tryStatus)
+        _sendErrorResponse(_tryStatus);
+    else if (_tryMatch.isCGI)
+    {
+        _isCGI = true;
+        _handleCGI(_tryMatch);
+    }
+    else if (_tryMatch.isFile)
+        _sendFile(_tryMatch.file, _tryMatch.gzipStatic);
+    else
+        _serveDict(_tryMatch);
+}
+
+// RFC 9110 14.2, 206 with the satisfiable ranges, 416 if there are none,
+// or 200 when the header doesn't apply and the whole file is sent
+int     RequestHandler::_parseRanges(const CachedFile& file, ranges_t& ranges)
+{
+    strmap& headers = _request.getHeaders();
+    strmap::iterator it = headers.find("range");
+    if (it == headers.end() || !file.isFile())
+        return 200;
+
+    // If-Range: the client only wants the rest of the version it already has
+    strmap::iterator ifRange = headers.find("if-range");
+    if (ifRange != headers.end() && ifRange->second != file.etag && ifRange->second != file.lastModified)
+        return 200;
+
+    const std::string& spec = it->second;
+    if (spec.compare(0, 6, "bytes=") != 0)
+        return 200;
+
+    off_t size = file.st.st_size;
+    size_t count = 0;
+    for (size_t pos = 6; pos <= spec.size(); )
+    {
+        size_t end = spec.find(',', pos);
+        if (end == NPOS)
+            end = spec.size();
+
+        const char* p = spec.c_str() + pos;
+        const char* stop = spec.c_str() + end;
+        char* next;
+        off_t first = -1;
+        off_t last = -1;
+
+        while (*p == ' ' || *p == '\t')
+            ++p;
+        pos = end + 1;
+        if (p == stop) // empty list element, "bytes=0-1,,5-"
+            continue;
+        if (std::isdigit(static_cast<unsigned char>(*p)))
+        {
+            first = std::strtoll(p, &next, 10);
+            p = next;
+        }
+        if (*p++ != '-')
+            return 200;
+        if (std::isdigit(static_cast<unsigned char>(*p)))
+        {
+            last = std::strtoll(p, &next, 10);
+            p = next;
+        }
+        while (*p == ' ' || *p == '\t')
+            ++p;
+        if (p != stop || (first < 0 && last < 0) || (last >= 0 && first > last))
+            return 200;
+        if (++count > MAX_RANGES)
+            return 200;
+
+        if (first < 0) // suffix range, the last 'n' bytes
+        {
+            if (last == 0 || size == 0)
+                continue;
+            first = last >= size ? 0 : size - last;
+            last = size - 1;
+        }
+        else
+        {
+            if (first >= size)
+                continue;
+            if (last < 0 || last >= size)
+                last = size - 1;
+        }
+        ranges.push_back(std::make_pair(first, last));
+    }
+    if (!count) // a range-set needs one range at least
+        return 200;
+    return ranges.empty() ? 416 : 206;
+}
+
+// RFC 9110 13.1.2 / 13.1.3, only ever called for GET
+bool    RequestHandler::_isNotModified(const CachedFile& file)
+{
+    strmap& headers = _request.getHeaders();
+
+    // If-None-Match takes precedence, If-Modified-Since is ignored when it's there
+    strmap::iterator it = headers.find("if-none-match");
+    if (it != headers.end())
+    {
+        const std::string& list = it->second;
+        for (size_t pos = 0; pos < list.size(); )
+        {
+            size_t end = list.find(',', pos);
+            if (end == NPOS)
+                end = list.size();
+            size_t start = list.find_first_not_of(" \t", pos);
+            size_t last = list.find_last_not_of(" \t", end - 1);
+            if (start < end && last != NPOS && last >= start)
+            {
+                // weak comparison, 'W/"x"' matches '"x"'
+                if (list.compare(start, 2, "W/") == 0)
+                    start += 2;
+                if (list.compare(start, last - start + 1, "*") == 0
+                    || list.compare(start, last - start + 1, file.etag) == 0)
+                    return true;
+            }
+            pos = end + 1;
+        }
+        return false;
+    }
+
+    it = headers.find("if-modified-since");
+    if (it == headers.end())
+        return false;
+    // clients usually send back exactly what we sent them
+    if (it->second == file.lastModified)
+        return true;
+
+    struct tm tm;
+    std::memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(it->second.c_str(), HTTP_DATE_FORMAT, &tm);
+    if (!end || *end)
+        return false;
+    return file.st.st_mtime <= timegm(&tm);
 }
 
 void    RequestHandler::_handleCGI(const RouteMatch& match)
 {
     // idk pas the response to fill it or smth
     // run the script, see RouteMatch for more info.. etc
+    // the script starts as soon as the headers are in, what comes of the
+    // body after that is handed to it piece by piece
+    if (_cgiStarted)
+    {
+        _cgi.feedBody();
+        return;
+    }
     logger.debug("cgi start is called");
+    _cgiStarted = true;
     _cgiSrtartTime = time(NULL);
     _cgi.start(match, _request.hasBody());
 }
 
 void    RequestHandler::setError(int code) { _sendErrorResponse(code); }
+
+int     RequestHandler::_checkExpectation(const RouteMatch& match)
+{
+    // 'Expect: 100-continue' means the client holds the body back until we answer,
+    // so everything that would reject the request is decided here, before the upload.
+    strmap& headers = _request.getHeaders();
+    strmap::iterator it = headers.find("expect");
+    if (it == headers.end())
+        return 0;
+
+    std::string expect = it->second;
+    std::transform(expect.begin(), expect.end(), expect.begin(), ::tolower);
+    if (expect != "100-continue")
+        return 417;
+    if (!match.isValidMatch())
+        return 404;
+    if (!match.methodAllowed)
+        return 405;
+    if (_request.getBodySize() > match.maxBodySize)
+        return 413;
+
+    // HTTP/1.0 clients don't know about interim responses (RFC 9110 15.2)
+    _sendContinue = _request.getVers() == "HTTP/1.1" && !_request.isComplete();
+    return 0;
+}
+
+bool    RequestHandler::shouldSendContinue()
+{
+    bool send = _sendContinue;
+    _sendContinue = false;
+    return send;
+}
@@ -1,11 +1,105 @@
 #include "Response.hpp"
 
+struct statusLine
+{
+    int         code;
+    const char* line;
+    size_t      len;
+};
+
+// every status line is rendered at compile time, sending one is a single copy
+#define STATUS_LINE(code, reason) \
+    { code, "HTTP/1.1 " #code " " reason CRLF, sizeof("HTTP/1.1 " #code " " reason CRLF) - 1 }
+
+static const statusLine s_statusLines[] =
+{
+    // 1xx: Informational
+    STATUS_LINE(100, "Continue"),
+    STATUS_LINE(101, "Switching Protocols"),
+    STATUS_LINE(102, "Processing"),
+    STATUS_LINE(103, "Early Hints"),
+
+    // 2xx: Success
+    STATUS_LINE(200, "OK"),
+    STATUS_LINE(201, "Created"),
+    STATUS_LINE(202, "Accepted"),
+    STATUS_LINE(203, "Non-Authoritative Information"),
+    STATUS_LINE(204, "No Content"),
+    STATUS_LINE(205, "Reset Content"),
+    STATUS_LINE(206, "Partial Content"),
+    STATUS_LINE(207, "Multi-Status"),
+    STATUS_LINE(208, "Already Reported"),
+    STATUS_LINE(226, "IM Used"),
+
+    // 3xx: Redirection
+    STATUS_LINE(300, "Multiple Choices"),
+    STATUS_LINE(301, "Moved Permanently"),
+    STATUS_LINE(302, "Found"),
+    STATUS_LINE(303, "See Other"),
+    STATUS_LINE(304, "Not Modified"),
+    STATUS_LINE(305, "Use Proxy"),
+    // 306 is unused/reserved
+    STATUS_LINE(307, "Temporary Redirect"),
+    STATUS_LINE(308, "Permanent Redirect"),
+
+    // 4xx: Client Error
+    STATUS_LINE(400, "Bad Request"),
+    STATUS_LINE(401, "Unauthorized"),
+    STATUS_LINE(402, "Payment Required"),
+    STATUS_LINE(403, "Forbidden"),
+    STATUS_LINE(404, "Not Found"),
+    STATUS_LINE(405, "Method Not Allowed"),
+    STATUS_LINE(406, "Not Acceptable"),
+    STATUS_LINE(407, "Proxy Authentication Required"),
+    STATUS_LINE(408, "Request Timeout"),
+    STATUS_LINE(409, "Conflict"),
+    STATUS_LINE(410, "Gone"),
+    STATUS_LINE(411, "Length Required"),
+    STATUS_LINE(412, "Precondition Failed"),
+    STATUS_LINE(413, "Payload Too Large"),
+    STATUS_LINE(414, "URI Too Long"),
+    STATUS_LINE(415, "Unsupported Media Type"),
+    STATUS_LINE(416, "Range Not Satisfiable"),
+    STATUS_LINE(417, "Expectation Failed"),
+    STATUS_LINE(418, "I'm a Teapot"),           //  RFC 9110
+    STATUS_LINE(421, "Misdirected Request"),
+    STATUS_LINE(422, "Unprocessable Entity"),
+    STATUS_LINE(423, "Locked"),
+    STATUS_LINE(424, "Failed Dependency"),
+    STATUS_LINE(426, "Upgrade Required"),
+    STATUS_LINE(428, "Precondition Required"),
+    STATUS_LINE(429, "Too Many Requests"),
+    STATUS_LINE(431, "Request Header Fields Too Large"),
+    STATUS_LINE(451, "Unavailable For Legal Reasons"),
+
+    // 5xx: Server Error
+    STATUS_LINE(500, "Internal Server Error"),
+    STATUS_LINE(501, "Not Implemented"),
+    STATUS_LINE(502, "Bad Gateway"),
+    STATUS_LINE(503, "Service Unavailable"),
+    STATUS_LINE(504, "Gateway Timeout"),
+    STATUS_LINE(505, "HTTP Version Not Supported"),
+    STATUS_LINE(506, "Variant Also Negotiates"),
+    STATUS_LINE(507, "Insufficient Storage"),
+    STATUS_LINE(508, "Loop Detected"),
+    STATUS_LINE(510, "Not Extended"),
+    STATUS_LINE(511, "Network Authentication Required")
+};
+
+#define MIN_STATUS 100
+#define MAX_STATUS 599
+
 HTTPResponse::HTTPResponse(const std::string& version):
     _version(version),
     _response(BUFF_SIZE * 2),
-    _file_fd(-1),
+    _file_start(0),
     _file_size(0),
-    _bytes_sent(0)
+    _bytes_sent(0),
+    _next_part(0),
+    _segment(0),
+    _segment_sent(0),
+    _pipe(-1),
+    _pipe_left(0)
 {}
 
 HTTPResponse::~HTTPResponse()
@@ -13,10 +107,45 @@ HTTPResponse::~HTTPResponse()
     closeFile();
 }
 
+// renders 'n' backwards ending at 'end', returns where the first digit landed
+static char*    formatNumber(char* end, size_t n, unsigned base)
+{
+    static const char digits[] = "0123456789abcdef";
+
+    do {
+        *--end = digits[n % base];
+        n /= base;
+    } while (n);
+    return end;
+}
+
+void    HTTPResponse::_writeNumber(size_t n, unsigned base)
+{
+    char    buff[32];
+    char*   end = buff + sizeof(buff);
+    char*   start = formatNumber(end, n, base);
+    _response.write(start, end - start);
+}
+
+// headers go straight into the output buffer, piece by piece, no temporary line
+void    HTTPResponse::_writeHeader(const char* k, size_t klen, const char* v, size_t vlen)
+{
+    _response.write(k, klen);
+    _response.write(": ", 2);
+    _response.write(v, vlen);
+    _response.write(CRLF, 2);
+}
+
 void    HTTPResponse::addHeader(const std::string& k, const std::string& v)
 {
-    std::string line = k + ": " + v + CRLF;
-    _response.write(line.data(), line.length());
+    _writeHeader(k.data(), k.length(), v.data(), v.length());
+}
+void    HTTPResponse::addHeader(const std::string& k, size_t v)
+{
+    _response.write(k.data(), k.length());
+    _response.write(": ", 2);
+    _writeNumber(v, 10);
+    _response.write(CRLF, 2);
 }
 void    HTTPResponse::endHeaders()
 {
@@ -26,35 +155,208 @@ void    HTTPResponse::endHeaders()
 void    HTTPResponse::setBody(const std::string& data, const std::string& type)
 {
     addHeader("content-type", type);
-    addHeader("content-length", SSTR(data.length()));
+    addHeader("content-length", data.length());
     endHeaders();
     _response.write(data.data(), data.length());
 }
 
-bool    HTTPResponse::attachFile(const std::string& filepath) {
-    struct stat f;
-    if (stat(filepath.c_str(), &f) != 0)
+bool    HTTPResponse::attachFile(const filePtr& file)
+{
+    if (!file)
         return false;
-    
-    _file_fd = open(filepath.c_str(), O_RDONLY | O_NONBLOCK);
-    if (_file_fd == -1)
+    return attachFile(file, file->type);
+}
+bool    HTTPResponse::attachFile(const filePtr& file, const std::string& type)
+{
+    if (!file || file->fd == -1)
         return false;
 
-    _file_size = f.st_size;
-    addHeader("Content-type", _getContentType(filepath));
-    addHeader("Content-Length", SSTR(_file_size));
+    _file = file;
+    _file_start = 0;
+    _file_size = file->st.st_size;
+    _bytes_sent = 0;
+    addHeader("Content-type", type);
+    addHeader("Content-Length", _file_size);
     endHeaders();
-    
+
     return true;
 }
+bool    HTTPResponse::attachRange(const filePtr& file, const std::string& type, off_t first, off_t last)
+{
+    if (!file || file->fd == -1)
+        return false;
+
+    _file = file;
+    _file_start = first;
+    _file_size = last - first + 1;
+    _bytes_sent = 0;
+    addHeader("Content-type", type);
+    addHeader("Content-Range", "bytes " + SSTR(first << '-' << last << '/' << file->st.st_size));
+    addHeader("Content-Length", _file_size);
+    endHeaders();
+
+    return true;
+}
+bool    HTTPResponse::attachRanges(const filePtr& file, const std::string& type, const ranges_t& ranges)
+{
+    static size_t count = 0;
+
+    if (!file || file->fd == -1)
+        return false;
+
+    std::string boundary = "webserv_byteranges_" + SSTR(std::hex << ++count);
+    std::string total = "/" + SSTR(file->st.st_size);
+
+    // RFC 9110 14.6: every range is its own part, in the order requested
+    size_t length = 0;
+    _parts.resize(ranges.size() + 1);
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        filePart& part = _parts[i];
+        part.head = CRLF "--" + boundary + CRLF
+                    "Content-type: " + type + CRLF
+                    "Content-Range: bytes " + SSTR(ranges[i].first << '-' << ranges[i].second) + total + CRLF CRLF;
+        part.start = ranges[i].first;
+        part.size = ranges[i].second - ranges[i].first + 1;
+        length += part.head.size() + part.size;
+    }
+    _parts.back().head = CRLF "--" + boundary + "--" CRLF;
+    _parts.back().start = 0;
+    _parts.back().size = 0;
+    length += _parts.back().head.size();
+
+    _file = file;
+    _file_start = 0;
+    _file_size = 0;
+    _bytes_sent = 0;
+    _next_part = 0;
+    addHeader("Content-type", "multipart/byteranges; boundary=" + boundary);
+    addHeader("Content-Length", length);
+    endHeaders();
+
+    return true;
+}
+
+// moves on to the next byte range, its part headers are queued first
+bool    HTTPResponse::_nextPart()
+{
+    if (_next_part >= _parts.size())
+        return false;
+
+    const filePart& part = _parts[_next_part++];
+    _response.write(part.head.data(), part.head.size());
+    _file_start = part.start;
+    _file_size = part.size;
+    _bytes_sent = 0;
+    return true;
+}
+
 void    HTTPResponse::closeFile()
 {
-    if (_file_fd != -1)
+    // the fd belongs to the cache entry, it's closed with its last owner
+    _file.reset();
+    _file_start = 0;
+    _file_size = 0;
+    _bytes_sent = 0;
+    _parts.clear();
+    _next_part = 0;
+}
+
+size_t  HTTPResponse::peekFile(int& fd, off_t& offset)
+{
+    if (!_file || _response.getSize())
+        return 0;
+
+    if (_bytes_sent >= _file_size)
     {
-        ::close(_file_fd);
-        _file_fd = -1;
-        _file_size = 0;
-        _bytes_sent = 0;
+        // the next part's headers go through the buffer first
+        if (!_nextPart())
+            closeFile();
+        return 0;
+    }
+    fd = _file->fd;
+    offset = _file_start + _bytes_sent;
+    return _file_size - _bytes_sent;
+}
+void    HTTPResponse::consumeFile(size_t size) { _bytes_sent += size; }
+
+void    HTTPResponse::feedPipe(int fd, size_t size)
+{
+    if (!size)
+        return;
+    _writeNumber(size, 16);
+    _response.write(CRLF, 2);
+    _pipe = fd;
+    _pipe_left = size;
+}
+size_t  HTTPResponse::peekPipe(int& fd) const
+{
+    if (!_pipe_left || _response.getSize())
+        return 0;
+    fd = _pipe;
+    return _pipe_left;
+}
+void    HTTPResponse::consumePipe(size_t size)
+{
+    _pipe_left -= std::min(size, _pipe_left);
+    if (_pipe_left)
+        return;
+    // the chunk's trailing CRLF, what comes next is framed by the next feed
+    _response.write(CRLF, 2);
+    _pipe = -1;
+}
+bool    HTTPResponse::pipePending() const { return _pipe_left != 0; }
+
+void    HTTPResponse::attachContent(const contentPtr& content)
+{
+    attachSegment(content->data.data(), content->data.size(), content);
+}
+void    HTTPResponse::attachSegment(const char* data, size_t size, const contentPtr& owner)
+{
+    if (!size)
+        return;
+    memSegment segment;
+    segment.data = data;
+    segment.size = size;
+    segment.owner = owner;
+    _segments.push_back(segment);
+}
+bool    HTTPResponse::hasContent() const { return _segment < _segments.size(); }
+
+size_t  HTTPResponse::peekHead(char* buff, size_t size) { return _response.peek(buff, size); }
+size_t  HTTPResponse::peekContent(const char*& data) const
+{
+    if (_segment >= _segments.size())
+        return 0;
+    data = _segments[_segment].data + _segment_sent;
+    return _segments[_segment].size - _segment_sent;
+}
+size_t  HTTPResponse::peekContent(struct iovec* iov, size_t count) const
+{
+    size_t n = 0;
+    for (size_t i = _segment; i < _segments.size() && n < count; ++i, ++n)
+    {
+        size_t skip = i == _segment ? _segment_sent : 0;
+        iov[n].iov_base = const_cast<char*>(_segments[i].data + skip);
+        iov[n].iov_len = _segments[i].size - skip;
+    }
+    return n;
+}
+void    HTTPResponse::consume(size_t size)
+{
+    size_t head = std::min(size, _response.getSize());
+    _response.advanceRead(head);
+    size -= head;
+    while (size && _segment < _segments.size())
+    {
+        size_t left = std::min(size, _segments[_segment].size - _segment_sent);
+        _segment_sent += left;
+        size -= left;
+        if (_segment_sent == _segments[_segment].size)
+        {
+            ++_segment;
+            _segment_sent = 0;
+        }
     }
 }
 
@@ -68,18 +370,42 @@ ssize_t HTTPResponse::readNextChunk(char* buff, size_t size)
     if (toSend)
         return toSend;
 
-    if (_file_fd == -1)
+    const char* data;
+    toSend = std::min(peekContent(data), size);
+    if (toSend)
+    {
+        std::memcpy(buff, data, toSend);
+        consume(toSend);
+        return toSend;
+    }
+
+    int fd;
+    toSend = std::min(peekPipe(fd), size);
+    if (toSend)
+    {
+        ssize_t bytes = ::read(fd, buff, toSend);
+        if (bytes > 0)
+            consumePipe(bytes);
+        else if (bytes < 0 && errno == EAGAIN)
+            return 0;
+        return bytes ? bytes : -1;
+    }
+
+    if (!_file)
         return 0;
 
-    // If the entire file has been sent, we're done
+    // If the segment has been sent, move on to the next one or we're done
     if (_bytes_sent >= _file_size)
     {
+        if (_nextPart())
+            return readNextChunk(buff, size);
         closeFile();
         return 0;
     }
 
-    // read from the file
-    ssize_t bytes = ::read(_file_fd, buff, size);
+    // read from the file, the fd is shared so the offset is ours to track
+    size = std::min(size, _file_size - _bytes_sent);
+    ssize_t bytes = ::pread(_file->fd, buff, size, _file_start + _bytes_sent);
     if (bytes > 0)
         _bytes_sent += bytes;
 
@@ -96,7 +422,17 @@ bool    HTTPResponse::isComplete() const
         logger.debug("Response not complete: no response data");
         return false;
     }
-    if (_file_size != _bytes_sent)
+    if (_segment < _segments.size())
+    {
+        logger.debug("Response not complete: cached content left");
+        return false;
+    }
+    if (_pipe_left)
+    {
+        logger.debug("Response not complete: CGI output left in the pipe");
+        return false;
+    }
+    if (_file_size != _bytes_sent || _next_part < _parts.size())
     {
         logger.debug("Response not complete: file size mismatch");
         return false;
@@ -108,150 +444,107 @@ void    HTTPResponse::reset()
 {
     _response.clear();
     closeFile();
+    _segments.clear();
+    _segment = 0;
+    _segment_sent = 0;
+    _pipe = -1;
+    _pipe_left = 0;
+    _compressor.reset();
 }
 
 void    HTTPResponse::startLine(int code)
 {
-    std::string line = _version + ' ' + SSTR(code) + ' ' + _getStatus(code) + CRLF;
-    _response.write(line.data(), line.length());
-}
-
-const std::string HTTPResponse::_getContentType(const std::string &filepath)
-{
-    size_t dotPos = filepath.rfind('.');
-    if (dotPos == std::string::npos)
-        return "application/octet-stream";
-    
-    const std::string& ext = filepath.substr(dotPos);
-    
-    // Text types
-    if (ext == ".html" || ext == ".htm") return "text/html";
-    if (ext == ".css")  return "text/css";
-    if (ext == ".js")   return "application/javascript";
-    if (ext == ".json") return "application/json";
-    if (ext == ".xml")  return "application/xml";
-    if (ext == ".txt")  return "text/plain";
-    
-    // Image types
-    if (ext == ".jpg" || ext == ".jpeg") return "image/jpeg";
-    if (ext == ".png")  return "image/png";
-    if (ext == ".gif")  return "image/gif";
-    if (ext == ".svg")  return "image/svg+xml";
-    if (ext == ".ico")  return "image/x-icon";
-    if (ext == ".webp") return "image/webp";
-    
-    // Font types
-    if (ext == ".woff")  return "font/woff";
-    if (ext == ".woff2") return "font/woff2";
-    if (ext == ".ttf") return "font/ttf";
-    if (ext == ".otf") return "font/otf";
-    
-    // Other
-    if (ext == ".pdf") return "application/pdf";
-    if (ext == ".zip") return "application/zip";
-    
-    return "application/octet-stream";
-}
-const std::string HTTPResponse::_getStatus(int code)
-{
-    switch (code) {
-        // 1xx: Informational
-        case 100: return "Continue";
-        case 101: return "Switching Protocols";
-        case 102: return "Processing";
-        case 103: return "Early Hints";
-
-        // 2xx: Success
-        case 200: return "OK";
-        case 201: return "Created";
-        case 202: return "Accepted";
-        case 203: return "Non-Authoritative Information";
-        case 204: return "No Content";
-        case 205: return "Reset Content";
-        case 206: return "Partial Content";
-        case 207: return "Multi-Status";
-        case 208: return "Already Reported";
-        case 226: return "IM Used";
-
-        // 3xx: Redirection
-        case 300: return "Multiple Choices";
-        case 301: return "Moved Permanently";
-        case 302: return "Found";
-        case 303: return "See Other";
-        case 304: return "Not Modified";
-        case 305: return "Use Proxy";
-        // 306 is unused/reserved
-        case 307: return "Temporary Redirect";
-        case 308: return "Permanent Redirect";
-
-        // 4xx: Client Error
-        case 400: return "Bad Request";
-        case 401: return "Unauthorized";
-        case 402: return "Payment Required";
-        case 403: return "Forbidden";
-        case 404: return "Not Found";
-        case 405: return "Method Not Allowed";
-        case 406: return "Not Acceptable";
-        case 407: return "Proxy Authentication Required";
-        case 408: return "Request Timeout";
-        case 409: return "Conflict";
-        case 410: return "Gone";
-        case 411: return "Length Required";
-        case 412: return "Precondition Failed";
-        case 413: return "Payload Too Large";
-        case 414: return "URI Too Long";
-        case 415: return "Unsupported Media Type";
-        case 416: return "Range Not Satisfiable";
-        case 417: return "Expectation Failed";
-        case 418: return "I'm a Teapot";          //  RFC 9110
-        case 421: return "Misdirected Request";
-        case 422: return "Unprocessable Entity";
-        case 423: return "Locked";
-        case 424: return "Failed Dependency";
-        case 426: return "Upgrade Required";
-        case 428: return "Precondition Required";
-        case 429: return "Too Many Requests";
-        case 431: return "Request Header Fields Too Large";
-        case 451: return "Unavailable For Legal Reasons";
-
-        // 5xx: Server Error
-        case 500: return "Internal Server Error";
-        case 501: return "Not Implemented";
-        case 502: return "Bad Gateway";
-        case 503: return "Service Unavailable";
-        case 504: return "Gateway Timeout";
-        case 505: return "HTTP Version Not Supported";
-        case 506: return "Variant Also Negotiates";
-        case 507: return "Insufficient Storage";
-        case 508: return "Loop Detected";
-        case 510: return "Not Extended";
-        case 511: return "Network Authentication Required";
-
-        default:
-            return "Unknown";
+    size_t      len;
+    const char* line = _getStatusLine(code, len);
+
+    if (line)
+        _response.write(line, len);
+    else
+    {
+        _response.write(_version.data(), _version.length());
+        _response.write(" ", 1);
+        _writeNumber(code, 10);
+        _response.write(" Unknown" CRLF, 10);
     }
+
+    line = _getDateHeader(len);
+    _response.write(line, len);
+    _response.write(SERVER_HEADER, sizeof(SERVER_HEADER) - 1);
 }
 
+// an empty feed ends the body, the compressor is flushed out before the last chunk
 void    HTTPResponse::feedRAW(const char* data, size_t size)
 {
-    std::stringstream ss;
-    ss << std::hex << size;
-    std::string sizeStr = ss.str();
+    if (_compressor.isActive())
+    {
+        char buff[BUFF_SIZE];
 
-    _response.write(sizeStr.data(), sizeStr.size());
+        _compressor.write(data, size, size == 0);
+        for (size_t n; (n = _compressor.read(buff, sizeof(buff))) > 0; )
+            _writeChunk(buff, n);
+        if (size != 0)
+            return;
+        _compressor.reset();
+    }
+    _writeChunk(data, size);
+}
+void    HTTPResponse::_writeChunk(const char* data, size_t size)
+{
+    _writeNumber(size, 16);
     _response.write(CRLF, 2);
     _response.write(data, size);
-    _response.write(CRLF, 2); 
+    _response.write(CRLF, 2);
 }
 void    HTTPResponse::feedRAW(const std::string& data)
 {
-    std::stringstream ss;
-    ss << std::hex << data.size();
-    std::string sizeStr = ss.str();
+    feedRAW(data.data(), data.size());
+}
 
-    _response.write(sizeStr.data(), sizeStr.size());
-    _response.write(CRLF, 2);
-    _response.write(data.data(), data.size());
-    _response.write(CRLF, 2);
+bool    HTTPResponse::isCompressing() const { return _compressor.isActive(); }
+bool    HTTPResponse::isFull() const { return _response.getSize() >= RESPONSE_HIGH_WATER; }
+bool    HTTPResponse::isDrained() const { return _response.getSize() <= RESPONSE_LOW_WATER; }
+
+bool    HTTPResponse::compressBody(coding_t coding, int level)
+{
+    if (!_compressor.start(coding, level))
+        return false;
+    addHeader("Content-Encoding", codingName(coding));
+    return true;
+}
+
+const char* HTTPResponse::_getStatusLine(int code, size_t& len)
+{
+    // code -> table entry, filled on first use
+    static const statusLine* index[MAX_STATUS - MIN_STATUS + 1];
+    static bool              indexed = false;
+
+    if (!indexed)
+    {
+        for (size_t i = 0; i < sizeof(s_statusLines) / sizeof(*s_statusLines); ++i)
+            index[s_statusLines[i].code - MIN_STATUS] = &s_statusLines[i];
+        indexed = true;
+    }
+    if (code < MIN_STATUS || code > MAX_STATUS || !index[code - MIN_STATUS])
+        return NULL;
+    len = index[code - MIN_STATUS]->len;
+    return index[code - MIN_STATUS]->line;
 }
 
+const char* HTTPResponse::_getDateHeader(size_t& len)
+{
+    // the clock only has a one second resolution, so every response
+    // sent during the same second shares the same rendered header
+    static char     header[64];
+    static size_t   headerLen = 0;
+    static time_t   renderedAt = -1;
+
+    time_t now = time(NULL);
+    if (now != renderedAt)
+    {
+        headerLen = std::strftime(header, sizeof(header),
+                        "Date: " HTTP_DATE_FORMAT CRLF, std::gmtime(&now));
+        renderedAt = now;
+    }
+    len = headerLen;
+    return header;
+}
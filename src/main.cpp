@@ -2,6 +2,8 @@
 
 #include "EventLoop.hpp"
 #include "Server.hpp"
+#include "FileWatcher.hpp"
+#include "CGIWorkers.hpp"
 
 std::string intToString(int value);
 
@@ -48,14 +50,44 @@ int main(int ac, char **av)
         std::vector<ServerConfig> servers = config.getServers();
 
         std::vector<Server *> serverInstances;
+        std::vector<VirtualHosts *> listeners;
 
+        // server blocks on the same host:port share one socket, the Host header picks the block
         for (std::vector<ServerConfig>::iterator it = servers.begin(); it != servers.end(); ++it)
         {
-            Server *server = new Server(*it, eventLoop.fd_manager);
+            VirtualHosts *hosts = NULL;
+            for (size_t i = 0; i < listeners.size() && !hosts; ++i)
+            {
+                if (listeners[i]->host == it->host && listeners[i]->port == it->port)
+                    hosts = listeners[i];
+            }
+            if (!hosts)
+            {
+                hosts = new VirtualHosts(it->host, it->port);
+                listeners.push_back(hosts);
+            }
+            hosts->add(*it);
+            logger.info("Configured server: " + it->name + " on " + it->host + ":" + intToString(it->port));
+        }
+
+        for (size_t i = 0; i < listeners.size(); ++i)
+        {
+            Server *server = new Server(*listeners[i], eventLoop.fd_manager);
             serverInstances.push_back(server);
             eventLoop.fd_manager.add(server->get_fd(), server, EPOLLIN, false);
-            logger.info("Configured server: " + it->name + " on " + it->host + ":" + intToString(it->port));
         }
+
+        FileWatcher *watcher = new FileWatcher(eventLoop.fd_manager);
+        eventLoop.fd_manager.add(watcher->get_fd(), watcher, EPOLLIN, false);
+        for (std::vector<ServerConfig>::iterator it = servers.begin(); it != servers.end(); ++it)
+        {
+            watcher->watch(it->root);
+            for (size_t i = 0; i < it->locations.size(); ++i)
+                watcher->watch(it->locations[i].root);
+        }
+
+        cgiWorkers.start(eventLoop.fd_manager);
+
         logger.info("Starting webserver...");
 
         setup_signal_handlers();
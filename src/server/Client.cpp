@@ -7,10 +7,13 @@ std::string intToString(int value)
     return oss.str();
 }
 
-Client::Client(int socket_fd, ServerConfig &config, FdManager &fdm) : EventHandler(config, fdm, time(NULL) + DEFAULT_CLIENT_TIMEOUT),
+Client::Client(int socket_fd, VirtualHosts &hosts, FdManager &fdm) : EventHandler(hosts.getDefault(), fdm, time(NULL) + DEFAULT_CLIENT_TIMEOUT),
                                                                       _socket(socket_fd),
                                                                       _resp("HTTP/1.1"),
-                                                                      _handler(config, _req, _resp, fdm),
+                                                                      _handler(hosts, _req, _resp, fdm, socket_fd),
+                                                                      _sendLen(0),
+                                                                      _sendOff(0),
+                                                                      _interim(false),
                                                                       _strFD(intToString(socket_fd)),
                                                                       _state(ST_READING)
 {
@@ -71,10 +74,18 @@ void Client::onReadable()
 void Client::onWritable()
 {
     _sendData();
+    // room again for a CGI output that waits on this client
+    if (_state == ST_SENDING || _state == ST_PROCESSING)
+        _handler.resumeCGI();
     switch (_state)
     {
     case ST_SENDING:
         break;
+    case ST_PROCESSING:
+        // the rest of a 100 Continue is out, back to reading the body
+        if (_sendOff == _sendLen)
+            _fd_manager.modify(this, READ_EVENT);
+        break;
     case ST_ERROR:
         _processError();
         break;
@@ -128,11 +139,34 @@ bool Client::_readData()
 
     return true;
 }
+// a CGI's output can go out while its request body is still coming in,
+// the response is only over once the request is too
+bool Client::_isSent()
+{
+    return _state == ST_SENDING && _handler.isResComplete();
+}
+
 bool Client::_sendData()
 {
-    if (_state != ST_SENDING)
+    if (_state != ST_SENDING && _state != ST_PROCESSING)
         return false;
 
+    // the rest of a partial send goes before anything else
+    if (_sendOff < _sendLen)
+        return _sendBuffered();
+
+    if (_resp.hasContent())
+        return _sendContent();
+
+    int fd;
+    off_t offset;
+    size_t size = _resp.peekFile(fd, offset);
+    if (size)
+        return _sendFile(fd, offset, size);
+    size = _resp.peekPipe(fd);
+    if (size)
+        return _splice(fd, size);
+
     ssize_t toSend = _handler.readNextChunk(_sendBuff, BUFF_SIZE);
 
     if (toSend < 0)
@@ -143,7 +177,7 @@ bool Client::_sendData()
     }
     if (toSend == 0)
     {
-        if (_handler.isResComplete())
+        if (_isSent())
         {
             logger.debug("Client send response complete fd: " + _strFD);
             _state = ST_SENDCOMPLETE;
@@ -151,27 +185,114 @@ bool Client::_sendData()
         }
         return true;
     }
-    _handler.responseStarted = true;
-    ssize_t sent = _socket.send(_sendBuff, toSend, 0);
+    _sendLen = toSend;
+    _sendOff = 0;
+    return _sendBuffered();
+}
+
+bool Client::_sendBuffered()
+{
+    // what was read into _sendBuff is already gone from the response
+    ssize_t sent = ::send(get_fd(), _sendBuff + _sendOff, _sendLen - _sendOff, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EAGAIN)
+        return true;
+    if (sent < 0)
+    {
+        logger.error("Can't send data on client fd: " + _strFD);
+        _state = ST_ERROR;
+        return false;
+    }
+    // an interim response leaves room for an error page after it
+    if (!_interim)
+        _handler.responseStarted = true;
+    _sendOff += sent;
+    if (_sendOff < _sendLen)
+        return true;
+    _sendLen = 0;
+    _sendOff = 0;
+    _interim = false;
+
+    if (_isSent())
+    {
+        logger.debug("Sending response complete on client fd: " + _strFD);
+        _state = ST_SENDCOMPLETE;
+        return false;
+    }
+
+    return true;
+}
+
+bool Client::_sendContent()
+{
+    // a cached response goes out straight from memory, together with
+    // the status line still sitting in the response buffer
+    struct iovec iov[1 + MAX_SEGMENTS];
+
+    iov[0].iov_base = _sendBuff;
+    iov[0].iov_len = _resp.peekHead(_sendBuff, BUFF_SIZE);
+    size_t count = 1 + _resp.peekContent(iov + 1, MAX_SEGMENTS);
+
+    ssize_t sent = ::writev(get_fd(), iov, count);
+    if (sent < 0 && errno == EAGAIN)
+        return true;
     if (sent < 0)
     {
         logger.error("Can't send data on client fd: " + _strFD);
         _state = ST_ERROR;
         return false;
     }
-    if (sent < toSend)
+    _handler.responseStarted = true;
+    _resp.consume(sent);
+
+    if (_isSent())
     {
-        logger.warning("Partial send on client fd: " + _strFD);
+        logger.debug("Sending response complete on client fd: " + _strFD);
+        _state = ST_SENDCOMPLETE;
+        return false;
+    }
+    return true;
+}
+
+bool Client::_sendFile(int fd, off_t offset, size_t size)
+{
+    // file bodies go from the page cache to the socket, the offset is
+    // explicit since the fd is shared with other responses
+    ssize_t sent = ::sendfile(get_fd(), fd, &offset, size);
+    if (sent < 0 && errno == EAGAIN)
         return true;
+    if (sent <= 0)
+    {
+        logger.error("Can't send file on client fd: " + _strFD);
+        _state = ST_ERROR;
+        return false;
     }
+    _handler.responseStarted = true;
+    _resp.consumeFile(sent);
 
-    if (_handler.isResComplete())
+    if (_isSent())
     {
         logger.debug("Sending response complete on client fd: " + _strFD);
         _state = ST_SENDCOMPLETE;
         return false;
     }
+    return true;
+}
 
+bool Client::_splice(int fd, size_t size)
+{
+    // CGI output goes from its pipe to the socket without being copied
+    // in and out of user space, the chunk header went out before it
+    ssize_t sent = ::splice(fd, NULL, get_fd(), NULL, size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE);
+    if (sent < 0 && errno == EAGAIN)
+        return true;
+    if (sent <= 0)
+    {
+        logger.error("Can't relay CGI output on client fd: " + _strFD);
+        _state = ST_ERROR;
+        return false;
+    }
+    _handler.responseStarted = true;
+    _resp.consumePipe(sent);
     return true;
 }
 
@@ -184,6 +305,9 @@ void Client::_closeConnection()
 void Client::reset()
 {
     _handler.reset();
+    _sendLen = 0;
+    _sendOff = 0;
+    _interim = false;
     _state = ST_READING;
     _fd_manager.modify(this, READ_EVENT);
 }
@@ -202,13 +326,46 @@ void Client::_processError()
 }
 void Client::_processRequest()
 {
+    bool ready = _handler.processRequest();
     _keepAlive = _shouldKeepAlive();
-    if (!_handler.processRequest() && !_handler.isError())
+    if (_handler.shouldSendContinue())
+        _sendContinue();
+    if (_state == ST_ERROR)
+    {
+        _closeConnection();
+        return;
+    }
+    if (!ready && !_handler.isError())
         return;
     _state = ST_SENDING;
     _fd_manager.modify(this, WRITE_EVENT);
 }
 
+void Client::_sendContinue()
+{
+    // the interim response goes out right away, the client is blocked on it;
+    // what the socket doesn't take waits in _sendBuff, ahead of the response
+    static const char msg[] = "HTTP/1.1 100 Continue" CRLF CRLF;
+    const size_t len = sizeof(msg) - 1;
+
+    ssize_t sent = ::send(get_fd(), msg, len, MSG_NOSIGNAL);
+    if (sent < 0 && errno != EAGAIN)
+    {
+        logger.error("Can't send 100 Continue on client fd: " + _strFD);
+        _state = ST_ERROR;
+        return;
+    }
+    if (sent == static_cast<ssize_t>(len))
+        return;
+    if (sent < 0)
+        sent = 0;
+    std::memcpy(_sendBuff, msg, len);
+    _sendLen = len;
+    _sendOff = sent;
+    _interim = true;
+    _fd_manager.modify(this, READ_WRITE_EVENT);
+}
+
 bool Client::_shouldKeepAlive()
 {
     return _handler.keepAlive();
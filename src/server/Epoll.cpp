@@ -8,7 +8,7 @@ extern volatile sig_atomic_t g_shutdown;
 
 Epoll::Epoll()
 {
-    _epoll_fd = epoll_create1(0);
+    _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
     if (_epoll_fd == -1)
     {
         throw std::runtime_error("Failed to create epoll file descriptor");
@@ -48,7 +48,8 @@ void EventLoop::expireTimeouts()
     {
         time_t now = time(NULL);
         EventHandler *handler = it->second;
-        if (!handler)
+        // an earlier timeout may have closed it (a client and its FastCGI connection)
+        if (!handler || fd_manager.getOwner(it->first) != handler)
             continue;
         if (handler->getExpiresAt() <= now)
         {
@@ -75,7 +76,11 @@ void EventLoop::run()
     logger.info("Event loop started");
     while (!g_shutdown)
     {
-        std::vector<epoll_event> events = epoll.wait(DEFAULT_WAIT);
+        // woken up for the next timeout, child processes are stopped by one
+        int wait = computeNextTimeout();
+        if (wait < 0 || wait > DEFAULT_WAIT)
+            wait = DEFAULT_WAIT;
+        std::vector<epoll_event> events = epoll.wait(wait);
         expireTimeouts();
         for (size_t i = 0; i < events.size(); i++)
         {
@@ -0,0 +1,164 @@
+#include "FileWatcher.hpp"
+#include "FileCache.hpp"
+#include "ContentCache.hpp"
+#include "DirListing.hpp"
+#include <dirent.h>
+#include <unistd.h>
+#include <cerrno>
+
+#define WATCH_MASK (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | \
+                    IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+FileWatcher::FileWatcher(FdManager &fdm) : EventHandler(ServerConfig(), fdm, -1)
+{
+    _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_fd == -1)
+        throw std::runtime_error("Failed to create inotify instance");
+}
+
+FileWatcher::~FileWatcher()
+{
+    if (_fd != -1)
+        close(_fd);
+}
+
+void FileWatcher::watch(const std::string &root)
+{
+    std::string dir = root;
+    while (dir.size() > 1 && dir[dir.size() - 1] == '/')
+        dir.erase(dir.size() - 1);
+
+    // watching '/' would mean the whole filesystem
+    if (dir.empty() || dir == "/")
+        return;
+    _roots.insert(dir);
+    _watchTree(dir);
+}
+
+void FileWatcher::_watchTree(const std::string &dir)
+{
+    if (_dirs.size() >= MAX_WATCHES)
+    {
+        Logger logger;
+        logger.warning("Too many directories to watch, cache invalidation falls back to stat: " + dir);
+        return;
+    }
+
+    int wd = inotify_add_watch(_fd, dir.c_str(), WATCH_MASK | IN_ONLYDIR);
+    if (wd == -1)
+        return;
+    std::map<int, std::string>::iterator it = _dirs.find(wd);
+    if (it != _dirs.end() && it->second != dir) // already watched (same dir, other name)
+        return;
+    _dirs[wd] = dir;    // walked again after an overflow, for what it missed
+
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return;
+    for (dirent *entry = readdir(d); entry; entry = readdir(d))
+    {
+        std::string name = entry->d_name;
+        if (name == "." || name == ".." || entry->d_type != DT_DIR)
+            continue;
+        _watchTree(dir + '/' + name);
+    }
+    closedir(d);
+}
+
+void FileWatcher::_invalidate(const std::string &path)
+{
+    // a directory is reached with and without its trailing slash
+    fileCache.invalidate(path);
+    fileCache.invalidate(path + '/');
+    contentCache.invalidate(path);
+    dirCache.invalidate(path);
+    dirCache.invalidate(path + '/');
+}
+
+// events were lost: nothing cached can be trusted, and directories
+// created meanwhile aren't watched yet
+void FileWatcher::_overflow()
+{
+    Logger logger;
+    logger.warning("inotify queue overflow, dropping every cache");
+    fileCache.clear();
+    contentCache.clear();
+    dirCache.clear();
+    for (std::set<std::string>::iterator it = _roots.begin(); it != _roots.end(); ++it)
+        _watchTree(*it);
+}
+
+int FileWatcher::get_fd()
+{
+    return _fd;
+}
+
+void FileWatcher::destroy()
+{
+    delete this;
+}
+
+void FileWatcher::onEvent(uint32_t events)
+{
+    if (IS_ERROR_EVENT(events))
+    {
+        onError();
+        return;
+    }
+    if (IS_READ_EVENT(events))
+        onReadable();
+}
+
+void FileWatcher::onReadable()
+{
+    char buff[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (true)
+    {
+        ssize_t size = read(_fd, buff, sizeof(buff));
+        if (size <= 0)
+            return;
+
+        for (char *ptr = buff; ptr < buff + size;)
+        {
+            const struct inotify_event *event = reinterpret_cast<struct inotify_event *>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                _overflow();
+                continue;
+            }
+            std::map<int, std::string>::iterator it = _dirs.find(event->wd);
+            if (it == _dirs.end())
+                continue;
+            if (event->mask & IN_IGNORED)
+            {
+                // the directory went away (deleted, moved, unmounted), a new
+                // one may already be in its place
+                std::string dir = it->second;
+                _dirs.erase(it);
+                _invalidate(dir);
+                _watchTree(dir);
+                continue;
+            }
+
+            // the directory itself changed too (mtime, listing)
+            _invalidate(it->second);
+            if (!event->len)
+                continue;
+
+            std::string path = it->second + '/' + event->name;
+            _invalidate(path);
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+                _watchTree(path);
+        }
+    }
+}
+
+void FileWatcher::onError()
+{
+    Logger logger;
+    logger.error("Error on inotify fd: " + intToString(_fd));
+    _fd_manager.remove(_fd);
+}
@@ -11,7 +11,8 @@ void Pipe::open()
 {
     Logger logger;
     logger.info("Creating pipe");
-    if (pipe(fd) == -1)
+    // never inherited by a child but through its stdin/stdout, see spawnProcess()
+    if (pipe2(fd, O_CLOEXEC) == -1)
     {
         logger.debug("pipe() syscall failed");
         throw std::runtime_error("Failed to create pipe");
@@ -5,8 +5,9 @@
 
 #define SSTR(x) static_cast<std::ostringstream &>((std::ostringstream() << x)).str()
 
-Server::Server(ServerConfig &config, FdManager &fdm)
-    : EventHandler(config, fdm, -1)
+Server::Server(VirtualHosts &hosts, FdManager &fdm)
+    : EventHandler(hosts.getDefault(), fdm, -1),
+      _hosts(hosts)
 {
     Logger logger;
 
@@ -18,14 +19,14 @@ Server::Server(ServerConfig &config, FdManager &fdm)
 
     struct sockaddr_in address;
     address.sin_family = AF_INET;
-    address.sin_addr.s_addr = inet_addr(config.host.c_str());
-    address.sin_port = htons(config.port);
+    address.sin_addr.s_addr = inet_addr(hosts.host.c_str());
+    address.sin_port = htons(hosts.port);
 
     _socket.bind(address);
     _socket.listen();
     _socket.set_non_blocking();
 
-    logger.info("Server initialized on " + config.host + ":" + SSTR(config.port));
+    logger.info("Server initialized on " + hosts.host + ":" + SSTR(hosts.port));
 }
 
 Server::~Server()
@@ -62,7 +63,7 @@ void Server::onReadable()
 
         logger.info("New client connection accepted on fd: " + SSTR(client_socket));
 
-        Client *client = new Client(client_socket, _config, _fd_manager);
+        Client *client = new Client(client_socket, _hosts, _fd_manager);
 
         _fd_manager.add(client->get_fd(), client, READ_EVENT);
     }
@@ -18,7 +18,7 @@ void Socket::register_epoll(Epoll *epoll)
 void Socket::create_socket(int domain, int type, int protocol)
 {
     _epoll = NULL;
-    _fd = ::socket(domain, type, protocol);
+    _fd = ::socket(domain, type | SOCK_CLOEXEC, protocol);
     if (_fd == -1)
     {
         throw std::runtime_error("Failed to create socket");
@@ -82,7 +82,7 @@ int Socket::accept()
     struct sockaddr_in client_addr;
     socklen_t client_len = sizeof(client_addr);
 
-    int client_fd = ::accept(_fd, (struct sockaddr *)&client_addr, &client_len);
+    int client_fd = ::accept4(_fd, (struct sockaddr *)&client_addr, &client_len, SOCK_CLOEXEC);
     if (client_fd < 0)
     {
         throw std::runtime_error("Failed to accept connection");
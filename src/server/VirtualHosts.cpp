@@ -0,0 +1,123 @@
+#include "VirtualHosts.hpp"
+#include <cctype>
+
+#define INITIAL_SLOTS 16
+
+VirtualHosts::VirtualHosts(const std::string& h, int p):
+    _table(INITIAL_SLOTS),
+    _count(0),
+    host(h),
+    port(p)
+{}
+
+// FNV-1a over the lowercased name
+size_t  VirtualHosts::_hash(const char* name, size_t len)
+{
+    size_t h = 2166136261u;
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(name[i])));
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// the slot holding 'name', or the empty one where it would go
+size_t  VirtualHosts::_slot(const char* name, size_t len) const
+{
+    size_t mask = _table.size() - 1;
+    size_t i = _hash(name, len) & mask;
+
+    while (_table[i].server)
+    {
+        const std::string& key = _table[i].name;
+        if (key.size() == len)
+        {
+            size_t j = 0;
+            while (j < len && key[j] == std::tolower(static_cast<unsigned char>(name[j])))
+                ++j;
+            if (j == len)
+                break;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+void    VirtualHosts::_grow()
+{
+    std::vector<entry> old(_table.size() * 2);
+    old.swap(_table);
+    for (size_t i = 0; i < old.size(); ++i)
+    {
+        if (!old[i].server)
+            continue;
+        entry& e = _table[_slot(old[i].name.data(), old[i].name.size())];
+        e.name.swap(old[i].name);
+        e.server = old[i].server;
+    }
+}
+
+void    VirtualHosts::_add(const std::string& name, ServerConfig* server)
+{
+    if (name.empty())
+        return;
+    // keep the load under 1/2 so probe chains stay short
+    if ((_count + 1) * 2 > _table.size())
+        _grow();
+
+    entry& e = _table[_slot(name.data(), name.size())];
+    if (e.server)
+        return;
+    e.name = name;
+    for (size_t i = 0; i < e.name.size(); ++i)
+        e.name[i] = std::tolower(static_cast<unsigned char>(e.name[i]));
+    e.server = server;
+    ++_count;
+}
+
+void    VirtualHosts::add(ServerConfig& server)
+{
+    _servers.push_back(&server);
+    for (size_t i = 0; i < server.names.size(); ++i)
+    {
+        const std::string& name = server.names[i];
+        if (name.compare(0, 2, "*.") == 0)
+            _add(name.substr(1), &server);
+        else
+            _add(name, &server);
+    }
+}
+
+ServerConfig&   VirtualHosts::getDefault() const { return *_servers[0]; }
+
+ServerConfig&   VirtualHosts::find(const std::string& value) const
+{
+    // a single block has nothing to choose from
+    if (_servers.size() == 1 || value.empty())
+        return getDefault();
+
+    // drop the port and a trailing dot, "Example.COM.:8080" is example.com
+    size_t len = value.size();
+    size_t colon = value.find_last_of(":]");
+    if (colon != std::string::npos && value[colon] == ':')
+        len = colon;
+    if (len && value[len - 1] == '.')
+        --len;
+    const char* name = value.data();
+
+    const entry& exact = _table[_slot(name, len)];
+    if (exact.server)
+        return *exact.server;
+
+    // "*.example.com" covers any depth, the longest wildcard wins
+    for (size_t i = 1; i < len; ++i)
+    {
+        if (name[i] != '.')
+            continue;
+        const entry& wild = _table[_slot(name + i, len - i)];
+        if (wild.server)
+            return *wild.server;
+    }
+    return getDefault();
+}
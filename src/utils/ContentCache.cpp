@@ -0,0 +1,121 @@
+#include "ContentCache.hpp"
+#include <sstream>
+#include <unistd.h>
+
+ContentCache contentCache;
+
+bool    CachedContent::matches(const struct stat& st) const
+{
+    return ino == st.st_ino && size == st.st_size
+        && mtime == st.st_mtim.tv_sec && mtimeNsec == st.st_mtim.tv_nsec;
+}
+
+ContentCache::ContentCache():
+    _budget(CONTENT_CACHE_SIZE),
+    _used(0),
+    _maxFile(CONTENT_CACHE_MAX_FILE)
+{}
+
+contentPtr  ContentCache::get(const filePtr& file)
+{
+    if (!file)
+        return contentPtr();
+    return get(file, file->type);
+}
+
+// 'type' differs from the file's own for gzip_static siblings (app.js.gz)
+contentPtr  ContentCache::get(const filePtr& file, const std::string& type)
+{
+    if (!_budget || !file || !file->isFile() || file->fd == -1)
+        return contentPtr();
+    if (static_cast<size_t>(file->st.st_size) > _maxFile || static_cast<size_t>(file->st.st_size) > _budget)
+        return contentPtr();
+
+    map_t::iterator it = _entries.find(file->path);
+    if (it != _entries.end())
+    {
+        if (it->second.content->matches(file->st) && it->second.content->type == type)
+        {
+            _lru.splice(_lru.begin(), _lru, it->second.pos);
+            return it->second.content;
+        }
+        _evict(it);
+    }
+
+    contentPtr content = _render(*file, type);
+    if (!content)
+        return content;
+
+    while (!_lru.empty() && _used + content->data.size() > _budget)
+        _evict(_entries.find(_lru.back()));
+
+    _lru.push_front(file->path);
+    node& n = _entries[file->path];
+    n.content = content;
+    n.pos = _lru.begin();
+    _used += content->data.size();
+    return content;
+}
+
+contentPtr  ContentCache::_render(const CachedFile& file, const std::string& type)
+{
+    std::ostringstream head;
+    head << "Content-type: " << type << "\r\n"
+         << "Content-Length: " << file.st.st_size << "\r\n"
+         << "Accept-Ranges: bytes\r\n"
+         << "ETag: " << file.etag << "\r\n"
+         << "Last-Modified: " << file.lastModified << "\r\n"
+         << "\r\n";
+
+    contentPtr content(new CachedContent);
+    content->type = type;
+    content->ino = file.st.st_ino;
+    content->size = file.st.st_size;
+    content->mtime = file.st.st_mtim.tv_sec;
+    content->mtimeNsec = file.st.st_mtim.tv_nsec;
+
+    std::string& data = content->data;
+    data.reserve(head.str().size() + file.st.st_size);
+    data = head.str();
+
+    size_t offset = data.size();
+    data.resize(offset + file.st.st_size);
+    for (off_t done = 0; done < file.st.st_size; )
+    {
+        ssize_t bytes = ::pread(file.fd, &data[offset + done], file.st.st_size - done, done);
+        if (bytes <= 0) // shrunk under us or unreadable, serve it from disk
+            return contentPtr();
+        done += bytes;
+    }
+    return content;
+}
+
+// responses still holding the entry keep it alive until they're sent
+void    ContentCache::_evict(map_t::iterator it)
+{
+    _used -= it->second.content->data.size();
+    _lru.erase(it->second.pos);
+    _entries.erase(it);
+}
+
+void    ContentCache::invalidate(const std::string& path)
+{
+    map_t::iterator it = _entries.find(path);
+    if (it != _entries.end())
+        _evict(it);
+}
+
+void    ContentCache::clear()
+{
+    _entries.clear();
+    _lru.clear();
+    _used = 0;
+}
+
+void    ContentCache::setBudget(size_t bytes)
+{
+    _budget = bytes;
+    while (!_lru.empty() && _used > _budget)
+        _evict(_entries.find(_lru.back()));
+}
+void    ContentCache::setMaxFile(size_t bytes) { _maxFile = bytes; }
@@ -0,0 +1,232 @@
+#include "FileCache.hpp"
+#include "MimeTypes.hpp"
+#include "Logger.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/openat2.h>
+
+FileCache fileCache;
+
+CachedFile::CachedFile(const std::string& p, int root, size_t len):
+    path(p),
+    fd(-1),
+    err(0),
+    checkedAt(time(NULL)),
+    rootFd(root),
+    rootLen(len)
+{
+    // O_NONBLOCK so a fifo can't block the open, an unreadable path still
+    // exists (403, not 404) so it's looked at through O_PATH
+    int opened = open(O_RDONLY | O_NONBLOCK);
+    bool readable = opened != -1;
+    if (!readable && errno == EACCES)
+        opened = open(O_PATH);
+    if (opened == -1 || fstat(opened, &st) != 0)
+    {
+        err = errno;
+        if (opened != -1)
+            ::close(opened);
+        return;
+    }
+    if (readable && S_ISREG(st.st_mode))
+        fd = opened;
+    else
+        ::close(opened);
+    if (!S_ISREG(st.st_mode))
+        return;
+    type = mimeTypes.lookup(path);
+
+    // changes whenever the file is replaced, resized or touched
+    char buff[64];
+    snprintf(buff, sizeof(buff), "\"%lx-%lx-%lx\"", static_cast<unsigned long>(st.st_ino),
+             static_cast<unsigned long>(st.st_size), static_cast<unsigned long>(st.st_mtime));
+    etag = buff;
+    if (strftime(buff, sizeof(buff), HTTP_DATE_FORMAT, gmtime(&st.st_mtime)))
+        lastModified = buff;
+}
+
+static bool hasOpenat2 = true;
+
+int     CachedFile::open(int flags) const
+{
+    const char* relative = path.c_str() + rootLen;
+    while (*relative == '/')
+        ++relative;
+
+    // no root, or one that isn't a directory (an exact route mapped to a
+    // file): only the configured path itself can be opened as is
+    if (rootFd == -1)
+    {
+        if (rootLen && *relative)
+        {
+            errno = ENOENT;
+            return -1;
+        }
+        return ::open(path.c_str(), flags | O_CLOEXEC);
+    }
+    if (!*relative)
+        relative = ".";
+
+    // without openat2 (before linux 5.6) uris are still normalized, so
+    // nothing but a symlink under the root can lead out of it
+    if (!hasOpenat2)
+        return openat(rootFd, relative, flags | O_CLOEXEC);
+
+    struct open_how how;
+    std::memset(&how, 0, sizeof(how));
+    how.flags = flags | O_CLOEXEC;
+    how.resolve = RESOLVE_BENEATH;
+    return syscall(SYS_openat2, rootFd, relative, &how, sizeof(how));
+}
+
+int     CachedFile::unlink() const
+{
+    const char* relative = path.c_str() + rootLen;
+    while (*relative == '/')
+        ++relative;
+
+    if (rootFd == -1)
+    {
+        if (rootLen && *relative)
+        {
+            errno = ENOENT;
+            return -1;
+        }
+        return ::unlink(path.c_str());
+    }
+    return unlinkat(rootFd, relative, 0);
+}
+
+CachedFile::~CachedFile()
+{
+    if (fd != -1)
+        ::close(fd);
+}
+
+bool    CachedFile::exists() const { return err == 0; }
+bool    CachedFile::isFile() const { return !err && S_ISREG(st.st_mode); }
+bool    CachedFile::isDirectory() const { return !err && S_ISDIR(st.st_mode); }
+
+FileCache::FileCache():
+    _maxEntries(std::min(static_cast<size_t>(FILE_CACHE_MAX), fdBudget())),
+    _valid(FILE_CACHE_VALID),
+    _cacheErrors(false)
+{}
+
+FileCache::~FileCache()
+{
+    for (std::map<std::string, int>::iterator it = _roots.begin(); it != _roots.end(); ++it)
+    {
+        if (it->second != -1)
+            ::close(it->second);
+    }
+}
+
+int     FileCache::openRoot(const std::string& dir)
+{
+    std::map<std::string, int>::iterator it = _roots.find(dir);
+    if (it != _roots.end())
+        return it->second;
+
+    Logger logger;
+    int fd = ::open(dir.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    _roots[dir] = fd;
+    if (fd == -1)
+    {
+        if (errno != ENOTDIR)
+            logger.error("Can't open root " + dir + ": " + std::strerror(errno) + ", nothing beneath it is served");
+        return fd;
+    }
+
+    struct open_how how;
+    std::memset(&how, 0, sizeof(how));
+    how.flags = O_PATH | O_CLOEXEC;
+    how.resolve = RESOLVE_BENEATH;
+    int probe = syscall(SYS_openat2, fd, ".", &how, sizeof(how));
+    if (probe != -1)
+        ::close(probe);
+    else if (errno == ENOSYS && hasOpenat2)
+    {
+        hasOpenat2 = false;
+        logger.error("openat2() isn't supported by this kernel, symlinks can lead out of a location's root");
+    }
+    return fd;
+}
+
+filePtr FileCache::get(const std::string& path, int rootFd, size_t rootLen)
+{
+    if (!_maxEntries)
+        return filePtr(new CachedFile(path, rootFd, rootLen));
+
+    map_t::iterator it = _entries.find(path);
+    if (it != _entries.end())
+    {
+        const CachedFile& cached = *it->second.file;
+        // only an entry resolved beneath the same root is any good, the
+        // path alone says nothing about how it was opened
+        if (cached.rootFd == rootFd && cached.rootLen == rootLen
+            && time(NULL) - cached.checkedAt < _valid)
+        {
+            _lru.splice(_lru.begin(), _lru, it->second.pos);
+            return it->second.file;
+        }
+        _evict(it);
+    }
+
+    filePtr file(new CachedFile(path, rootFd, rootLen));
+    if (!file->exists() && !_cacheErrors)
+        return file;
+
+    if (_entries.size() >= _maxEntries)
+        _evict(_entries.find(_lru.back()));
+
+    _lru.push_front(path);
+    node& n = _entries[path];
+    n.file = file;
+    n.pos = _lru.begin();
+    return file;
+}
+
+// the entry leaves the cache, responses still holding it keep the fd open
+void    FileCache::_evict(map_t::iterator it)
+{
+    _lru.erase(it->second.pos);
+    _entries.erase(it);
+}
+
+void    FileCache::invalidate(const std::string& path)
+{
+    map_t::iterator it = _entries.find(path);
+    if (it != _entries.end())
+        _evict(it);
+}
+
+void    FileCache::clear()
+{
+    _entries.clear();
+    _lru.clear();
+}
+
+// cached fds must leave room for clients, or accept() fails with EMFILE
+size_t  FileCache::fdBudget()
+{
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur == RLIM_INFINITY)
+        return FILE_CACHE_MAX;
+    return rl.rlim_cur / 4;
+}
+
+void    FileCache::setMaxEntries(size_t max)
+{
+    _maxEntries = std::min(max, fdBudget());
+    while (_entries.size() > _maxEntries)
+        _evict(_entries.find(_lru.back()));
+}
+void    FileCache::setValid(time_t seconds) { _valid = seconds; }
+void    FileCache::setCacheErrors(bool b) { _cacheErrors = b; }